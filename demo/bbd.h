@@ -0,0 +1,564 @@
+/*
+* Bordered-block-diagonal (BBD) building blocks shared by demo_bbd.cpp (blocks and border solved together) and demo_schur.cpp (one
+* interior block whose Schur complement is returned to the caller) with int indexes, and demo_distributed.cpp (one block per rank)
+* with long long indexes, row mode, real.
+* The nodes are split into diagonal blocks and border nodes. After permutation the matrix is
+*     | A11          A1b |
+*     |      ...     ... |
+*     |          Akk Akb |
+*     | Ab1 ...  Abk Abb |
+* and the border Schur complement is
+*     S = Abb - sum(Abk*Akk^(-1)*Akb)
+* Every block Akk is factorized by its own solver instance with full pivoting inside the block. Only the border columns touched by
+* Akb are solved, so Wk = Akk^(-1)*Akb is dense but narrow. S is sparse, with a pattern fixed by the split.
+* Pivots are not exchanged across blocks, so every block must be nonsingular, which a split of the nodes does not guarantee (e.g. a
+* voltage source whose terminals went to the border, or a subcircuit grounded only through border nodes). Isolate moves the nodes
+* that leave a block structurally singular to the border before analysis, and FactorizeRepaired moves the node of the singular row
+* of a block that fails with -6 and retries, so a nonsingular matrix is solved once its blocks are (the border is factorized with
+* full pivoting). A block that is nearly but not exactly singular factorizes without error and shows only in the residual.
+* BuildCircuit generates the test circuits of the demos.
+*/
+
+#ifndef __CKTSO_BBD__
+#define __CKTSO_BBD__
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include "cktso.h"
+#include "parallel.h"
+
+/*
+* ParallelFor: runs func(0)~func(count-1) on the threads of pool, each thread taking the next index until none is left.
+*/
+template <typename FUNC>
+void ParallelFor(WorkerPool &pool, int count, const FUNC &func)
+{
+    std::atomic<int> next(0);
+    pool.Run([&](int)
+    {
+        for (int i = next++; i < count; i = next++) func(i);
+    });
+}
+
+/*
+* Isolate: moves to the border the nodes that leave a block structurally singular, e.g. a voltage source branch whose two terminals
+* went to the border. Rows of every block are matched to columns of the same block by augmenting paths; the node of each unmatched
+* row is moved to the border (part=-1), which removes its row and column, and the matching is repeated until every block has a
+* perfect matching.
+* @return: # of nodes moved
+*/
+template <typename INT>
+INT Isolate(INT n, const INT ap[], const INT ai[], INT part[])
+{
+    std::vector<INT> match(n), rmatch(n), pos(n), st, via;
+    std::vector<INT> visited(n, -1);
+    INT moved = 0, count;
+    do
+    {
+        count = 0;
+        std::fill(match.begin(), match.end(), -1);
+        std::fill(rmatch.begin(), rmatch.end(), -1);
+        std::fill(visited.begin(), visited.end(), -1);
+        for (INT r0 = 0; r0 < n; ++r0)
+        {
+            if (part[r0] < 0) continue;
+            INT p = ap[r0];
+            while (p < ap[r0 + 1] && (part[ai[p]] != part[r0] || match[ai[p]] >= 0)) ++p;
+            if (p < ap[r0 + 1])
+            {
+                match[ai[p]] = r0;
+                rmatch[r0] = ai[p];
+                continue;
+            }
+
+            //Depth-first search for an augmenting path from row r0, columns are visited once per search
+            st.assign(1, r0);
+            via.clear();
+            pos[r0] = ap[r0];
+            while (!st.empty())
+            {
+                const INT r = st.back();
+                if (pos[r] == ap[r + 1])
+                {
+                    st.pop_back();
+                    if (!via.empty()) via.pop_back();
+                    continue;
+                }
+                const INT c = ai[pos[r]++];
+                if (part[c] != part[r] || visited[c] == r0) continue;
+                visited[c] = r0;
+                if (match[c] < 0)
+                {
+                    //Augment: every row on the stack takes the column that led to the next one, the top row takes c
+                    for (size_t l = st.size(); l-- > 0;)
+                    {
+                        const INT col = (l + 1 == st.size()) ? c : via[l];
+                        match[col] = st[l];
+                        rmatch[st[l]] = col;
+                    }
+                    break;
+                }
+                via.push_back(c);
+                st.push_back(match[c]);
+                pos[match[c]] = ap[match[c]];
+            }
+        }
+        for (INT i = 0; i < n; ++i)
+        {
+            if (part[i] >= 0 && rmatch[i] < 0)
+            {
+                part[i] = -1;
+                ++count;
+            }
+        }
+        moved += count;
+    } while (count > 0);
+    return moved;
+}
+
+enum
+{
+    BBD_MAX_ROUNDS = 32 //max # of re-analyses after singular blocks in one FactorizeRepaired
+};
+
+/*
+* FactorizeRepaired: factorizes with pivoting, and while a block fails with -6, moves the nodes of the singular rows to the border,
+* rebuilds and analyzes the blocks and S again and retries, at most BBD_MAX_ROUNDS times.
+* @numeric: int(std::vector<INT> &bad), factorizes with pivoting and gets the nodes of the singular rows of the blocks that failed
+*           with -6 (see BBDBlock::SingularNode)
+* @setup: int(), rebuilds and analyzes everything from part
+* @moved: incremented by the # of nodes moved
+*/
+template <typename INT, typename NUMERIC, typename SETUP>
+int FactorizeRepaired(INT part[], INT &moved, const NUMERIC &numeric, const SETUP &setup)
+{
+    int ret = 0;
+    for (int round = 0; ; ++round)
+    {
+        std::vector<INT> bad;
+        ret = numeric(bad);
+        if (ret != -6 || bad.empty() || round >= BBD_MAX_ROUNDS) break;
+        for (size_t e = 0; e < bad.size(); ++e) part[bad[e]] = -1;
+        moved += (INT)bad.size();
+        ret = setup();
+        if (ret < 0) break;
+    }
+    return ret;
+}
+
+/*
+* BBDInstance: solver instance type and creation for the index type INT, ICktSo for int and ICktSo_L for long long.
+*/
+template <typename INT>
+struct BBDInstance;
+
+template <>
+struct BBDInstance<int>
+{
+    typedef ICktSo Type;
+    static int Create(ICktSo *inst, int **iparm, const long long **oparm)
+    {
+        return CKTSO_CreateSolver(inst, iparm, oparm);
+    }
+};
+
+template <>
+struct BBDInstance<long long>
+{
+    typedef ICktSo_L Type;
+    static int Create(ICktSo_L *inst, int **iparm, const long long **oparm)
+    {
+        return CKTSO_L_CreateSolver(inst, iparm, oparm);
+    }
+};
+
+template <typename INT>
+struct BBDEntry
+{
+    BBDEntry(INT r_, INT c_, INT pos_) : r(r_), c(c_), pos(pos_)
+    {
+    }
+    INT r; //local row
+    INT c; //local column
+    INT pos; //position in ax
+};
+
+/*
+* BBDBlock: one diagonal block Akk with its couplings Akb and Abk. The solver instance is created by Create and destroyed by the
+* owner.
+*/
+template <typename INT>
+struct BBDBlock
+{
+    BBDBlock() : inst(NULL), oparm(NULL), axv(NULL)
+    {
+    }
+
+    /*
+    * Create: creates the solver instance if there is none.
+    */
+    int Create()
+    {
+        if (NULL != inst) return 0;
+        int *iparm;
+        return BBDInstance<INT>::Create(&inst, &iparm, &oparm);
+    }
+
+    /*
+    * Split: extracts Akk, Akb and Abk of block k.
+    * @part: block of each node, <0 for a border node
+    * @local: local index of each node in its block (nodes of a block are numbered in increasing order) or in the border
+    * @border: node of each border index
+    */
+    void Split(const INT ap[], const INT ai[], const std::vector<INT> &part, int k, const std::vector<INT> &local, const std::vector<INT> &border)
+    {
+        const INT nb = (INT)border.size();
+        const INT n = (INT)part.size();
+        glob.clear();
+        for (INT i = 0; i < n; ++i)
+        {
+            if (part[i] == k) glob.push_back(i);
+        }
+        const INT nk = (INT)glob.size();
+        kp.assign(nk + 1, 0);
+        ki.clear();
+        kpos.clear();
+        bcols.clear();
+        brows.clear();
+        kb.clear();
+        bk.clear();
+        std::vector<INT> colmap(nb, -1), rowmap(nb, -1);
+        for (INT l = 0; l < nk; ++l)
+        {
+            const INT i = glob[l];
+            for (INT p = ap[i]; p < ap[i + 1]; ++p)
+            {
+                const INT j = ai[p];
+                if (part[j] == k)
+                {
+                    ki.push_back(local[j]);
+                    kpos.push_back(p);
+                    continue;
+                }
+                const INT c = local[j];
+                if (colmap[c] < 0)
+                {
+                    colmap[c] = (INT)bcols.size();
+                    bcols.push_back(c);
+                }
+                kb.push_back(BBDEntry<INT>(l, colmap[c], p));
+            }
+            kp[l + 1] = (INT)ki.size();
+        }
+        for (INT r = 0; r < nb; ++r)
+        {
+            const INT i = border[r];
+            for (INT p = ap[i]; p < ap[i + 1]; ++p)
+            {
+                const INT j = ai[p];
+                if (part[j] != k) continue;
+                if (rowmap[r] < 0)
+                {
+                    rowmap[r] = (INT)brows.size();
+                    brows.push_back(r);
+                }
+                bk.push_back(BBDEntry<INT>(rowmap[r], local[j], p));
+            }
+        }
+        kx.resize(ki.size());
+        w.resize(glob.size() * bcols.size());
+        t.resize(brows.size() * bcols.size());
+        y.resize(glob.size());
+        g.resize(brows.size());
+        axv = NULL;
+    }
+
+    /*
+    * Analyze: analyzes Akk with the instance inst, which must be created first.
+    */
+    int Analyze(const double ax[], int threads)
+    {
+        if (glob.empty()) return 0;
+        Gather(ax);
+        return inst->Analyze(false, (INT)glob.size(), &kp[0], &ki[0], &kx[0], threads);
+    }
+
+    /*
+    * Gather: values of Akk from ax.
+    */
+    void Gather(const double ax[])
+    {
+        for (size_t p = 0; p < kpos.size(); ++p) kx[p] = ax[kpos[p]];
+    }
+
+    /*
+    * Eliminate: factorizes (with pivoting) or refactorizes Akk, then computes Wk=Akk^(-1)*Akb and Tk=Abk*Wk.
+    */
+    int Eliminate(const double ax[], bool refactor)
+    {
+        axv = NULL;
+        const size_t nk = glob.size();
+        if (0 == nk) return 0;
+        Gather(ax);
+        int ret = refactor ? inst->Refactorize(&kx[0]) : inst->Factorize(&kx[0], false);
+        if (ret < 0) return ret;
+        axv = ax;
+        const size_t nc = bcols.size();
+        if (0 == nc) return 0;
+        std::fill(w.begin(), w.end(), 0.);
+        for (size_t e = 0; e < kb.size(); ++e) w[(size_t)kb[e].c * nk + kb[e].r] += ax[kb[e].pos];
+        ret = inst->SolveMV(nc, &w[0], nk, &w[0], nk, false);
+        if (ret < 0)
+        {
+            axv = NULL;
+            return ret;
+        }
+        std::fill(t.begin(), t.end(), 0.);
+        for (size_t e = 0; e < bk.size(); ++e)
+        {
+            const BBDEntry<INT> &en = bk[e];
+            const double a = ax[en.pos];
+            double *tr = &t[(size_t)en.r * nc];
+            for (size_t c = 0; c < nc; ++c) tr[c] += a * w[c * nk + en.c];
+        }
+        return 0;
+    }
+
+    /*
+    * Condense: yk=Akk^(-1)*bk and gk=Abk*yk, the contribution of the block to the condensed border right-hand-side.
+    * @return: -9 if the block has not been factorized since the last Split
+    */
+    int Condense(const double b[], bool force_seq)
+    {
+        const size_t nk = glob.size();
+        if (0 == nk) return 0;
+        if (NULL == axv) return -9;
+        for (size_t l = 0; l < nk; ++l) y[l] = b[glob[l]];
+        const int ret = inst->Solve(&y[0], &y[0], force_seq, false);
+        if (ret < 0) return ret;
+        std::fill(g.begin(), g.end(), 0.);
+        for (size_t e = 0; e < bk.size(); ++e) g[bk[e].r] += axv[bk[e].pos] * y[bk[e].c];
+        return 0;
+    }
+
+    /*
+    * BackSubstitute: xk=yk-Wk*xb with the yk of the last Condense, scattered into x.
+    */
+    void BackSubstitute(const double xb[], double x[])
+    {
+        const size_t nk = glob.size();
+        for (size_t c = 0; c < bcols.size(); ++c)
+        {
+            const double v = xb[bcols[c]];
+            const double *wc = &w[c * nk];
+            for (size_t l = 0; l < nk; ++l) y[l] -= wc[l] * v;
+        }
+        for (size_t l = 0; l < nk; ++l) x[glob[l]] = y[l];
+    }
+
+    /*
+    * SingularNode: node of the singular row after Eliminate returned -6, or -1 if unknown.
+    */
+    INT SingularNode() const
+    {
+        const long long row = (NULL != oparm) ? oparm[9] : -1;
+        return (row >= 0 && row < (long long)glob.size()) ? glob[(size_t)row] : -1;
+    }
+
+    typename BBDInstance<INT>::Type inst;
+    const long long *oparm; //oparm of inst (used by SingularNode)
+    std::vector<INT> glob; //node of each local index
+    std::vector<INT> kp, ki, kpos; //Akk (CSR) and positions of its values in ax
+    std::vector<double> kx;
+    std::vector<INT> bcols; //border columns touched by Akb
+    std::vector<INT> brows; //border rows touched by Abk
+    std::vector<BBDEntry<INT> > kb; //Akb: (local row, index in bcols, position)
+    std::vector<BBDEntry<INT> > bk; //Abk: (index in brows, local column, position)
+    std::vector<INT> spos; //positions in S's values for brows x bcols (set by BBDSchur::Build)
+    std::vector<double> w; //Wk=Akk^(-1)*Akb, column by column
+    std::vector<double> t; //Tk=Abk*Wk
+    std::vector<double> y; //local solution
+    std::vector<double> g; //Abk*yk
+    const double *axv; //values of the last factorization, NULL before it
+};
+
+/*
+* BBDSchur: the border Schur complement S in CSR format.
+*/
+template <typename INT>
+class BBDSchur
+{
+public:
+    /*
+    * Build: pattern of S from Abb and the couplings of the blocks (the diagonal is always kept, so the pattern does not depend on
+    * values), and the positions of all contributions.
+    */
+    void Build(const INT ap[], const INT ai[], const std::vector<INT> &part, const std::vector<INT> &local, const std::vector<INT> &border,
+        BBDBlock<INT> blk[], int nblk)
+    {
+        const INT nb = (INT)border.size();
+        std::vector<std::vector<INT> > srow(nb);
+        std::vector<std::pair<INT, INT> > bb; //(position in ax, border row)
+        for (int k = 0; k < nblk; ++k)
+        {
+            const BBDBlock<INT> &b = blk[k];
+            for (size_t r = 0; r < b.brows.size(); ++r) srow[b.brows[r]].insert(srow[b.brows[r]].end(), b.bcols.begin(), b.bcols.end());
+        }
+        for (INT r = 0; r < nb; ++r)
+        {
+            const INT i = border[r];
+            for (INT p = ap[i]; p < ap[i + 1]; ++p)
+            {
+                if (part[ai[p]] < 0)
+                {
+                    srow[r].push_back(local[ai[p]]);
+                    bb.push_back(std::make_pair(p, r));
+                }
+            }
+            srow[r].push_back(r);
+        }
+        sp.assign(nb + 1, 0);
+        si.clear();
+        for (INT r = 0; r < nb; ++r)
+        {
+            std::sort(srow[r].begin(), srow[r].end());
+            srow[r].erase(std::unique(srow[r].begin(), srow[r].end()), srow[r].end());
+            si.insert(si.end(), srow[r].begin(), srow[r].end());
+            sp[r + 1] = (INT)si.size();
+        }
+        sx.assign(si.size(), 0.);
+        bbpos.clear();
+        for (size_t e = 0; e < bb.size(); ++e) bbpos.push_back(std::make_pair(bb[e].first, Find(bb[e].second, local[ai[bb[e].first]])));
+        for (int k = 0; k < nblk; ++k)
+        {
+            BBDBlock<INT> &b = blk[k];
+            const size_t nr = b.brows.size(), nc = b.bcols.size();
+            b.spos.resize(nr * nc);
+            for (size_t r = 0; r < nr; ++r)
+            {
+                for (size_t c = 0; c < nc; ++c) b.spos[r * nc + c] = Find(b.brows[r], b.bcols[c]);
+            }
+        }
+    }
+
+    /*
+    * Assemble: S=Abb-sum(Tk), after all blocks are eliminated.
+    */
+    void Assemble(const double ax[], const BBDBlock<INT> blk[], int nblk)
+    {
+        std::fill(sx.begin(), sx.end(), 0.);
+        for (size_t e = 0; e < bbpos.size(); ++e) sx[bbpos[e].second] += ax[bbpos[e].first];
+        for (int k = 0; k < nblk; ++k)
+        {
+            const BBDBlock<INT> &b = blk[k];
+            for (size_t q = 0; q < b.spos.size(); ++q) sx[b.spos[q]] -= b.t[q];
+        }
+    }
+
+    std::vector<INT> sp, si; //pattern of S
+    std::vector<double> sx;
+
+private:
+    INT Find(INT r, INT c) const
+    {
+        const INT *b = &si[0] + sp[r];
+        const INT *e = &si[0] + sp[r + 1];
+        return (INT)(std::lower_bound(b, e, c) - &si[0]);
+    }
+
+    std::vector<std::pair<INT, INT> > bbpos; //(position in ax, position in sx) for Abb
+};
+
+/*
+* BuildCircuit: test circuit of nparts subcircuits, each a grid of m x m nodes with random conductances and a few controlled sources
+* (unsymmetric entries), connected through nborder interface nodes. part[] gives the subcircuit of each node (-1 for interface).
+* @nsources: # of voltage sources that make a block singular under part[] (needs nborder>=2), alternately a source between two
+*            interface nodes with its branch current in a subcircuit (structurally singular block), and a source from an interface
+*            node to a resistor pair of a subcircuit grounded only through it, with its branch current on the interface
+*            (numerically singular block)
+*/
+inline void BuildCircuit(int nparts, int m, int nborder, int nsources, int &n, std::vector<int> &ap, std::vector<int> &ai, std::vector<double> &ax,
+    std::vector<int> &part)
+{
+    const int nk = m * m;
+    if (nborder < 2) nsources = 0;
+    n = nparts * nk + nborder + nsources + nsources / 2 * 2; //1 node for each structurally singular case, 3 for each numerical one
+    std::vector<std::vector<std::pair<int, double> > > rows(n);
+    part.assign(n, -1);
+    for (int i = 0; i < nparts * nk; ++i) part[i] = i / nk;
+    const auto stamp = [&](int a, int b, double g)
+    {
+        rows[a].push_back(std::make_pair(a, g));
+        rows[b].push_back(std::make_pair(b, g));
+        rows[a].push_back(std::make_pair(b, -g));
+        rows[b].push_back(std::make_pair(a, -g));
+    };
+    for (int k = 0; k < nparts; ++k)
+    {
+        const int base = k * nk;
+        for (int r = 0; r < m; ++r)
+        {
+            for (int c = 0; c < m; ++c)
+            {
+                const int i = base + r * m + c;
+                rows[i].push_back(std::make_pair(i, 1e-3)); //conductance to ground
+                if (c + 1 < m) stamp(i, i + 1, 1. + (double)rand() / RAND_MAX);
+                if (r + 1 < m) stamp(i, i + m, 1. + (double)rand() / RAND_MAX);
+                if (0 == rand() % 16 && r + 1 < m) rows[i + m].push_back(std::make_pair(i, .5)); //controlled source
+            }
+        }
+        for (int t = 0; t < nborder; ++t)
+        {
+            if (rand() % 2) stamp(base + rand() % nk, nparts * nk + t, 1.);
+        }
+    }
+    for (int t = 0; t < nborder; ++t) rows[nparts * nk + t].push_back(std::make_pair(nparts * nk + t, 1e-3));
+    const auto source = [&](int j, int a, int b) //branch current j of a source from node b to node a
+    {
+        rows[j].push_back(std::make_pair(a, 1.));
+        rows[a].push_back(std::make_pair(j, 1.));
+        rows[j].push_back(std::make_pair(b, -1.));
+        rows[b].push_back(std::make_pair(j, -1.));
+    };
+    for (int s = 0, i = nparts * nk + nborder; s < nsources; ++s)
+    {
+        const int k = s % nparts;
+        const int t = nparts * nk + rand() % nborder;
+        if (0 == s % 2)
+        {
+            //Branch current i in subcircuit k, between interface nodes t and t2
+            const int t2 = nparts * nk + (t - nparts * nk + 1) % nborder;
+            part[i] = k;
+            source(i, t, t2);
+            i += 1;
+        }
+        else
+        {
+            //Resistor pair i, i+1 in subcircuit k, branch current i+2 on the interface from t to i
+            part[i] = part[i + 1] = k;
+            stamp(i, i + 1, 1.); //exactly singular pair, so the factorization of the block returns -6
+            source(i + 2, i, t);
+            i += 3;
+        }
+    }
+
+    ap.assign(n + 1, 0);
+    ai.clear();
+    ax.clear();
+    for (int i = 0; i < n; ++i)
+    {
+        std::sort(rows[i].begin(), rows[i].end(), [](const std::pair<int, double> &a, const std::pair<int, double> &b) { return a.first < b.first; });
+        for (size_t e = 0; e < rows[i].size(); ++e)
+        {
+            if (!ai.empty() && (int)ai.size() > ap[i] && ai.back() == rows[i][e].first) ax.back() += rows[i][e].second;
+            else
+            {
+                ai.push_back(rows[i][e].first);
+                ax.push_back(rows[i][e].second);
+            }
+        }
+        ap[i + 1] = (int)ai.size();
+    }
+}
+
+#endif
@@ -9,134 +9,58 @@
 #include <math.h>
 #include <limits.h>
 #include "cktso.h"
+#include "matvec.h"
+#include "mtxio.h"
+#include "cktso_capture.h"
 #ifdef _MSC_VER
 #pragma comment(lib, "cktso.lib")
 #endif
 
-bool ReadMtxFile(const char file[], int &n, int *&ap, int *&ai, double *&ax)
+/*
+* Checksum: FNV-1a hash of the bytes of a solution, equal only for bitwise identical solutions.
+*/
+unsigned long long Checksum(const double x[], int n)
 {
-    FILE *fp = fopen(file, "r");
-    if (NULL == fp)
-    {
-        printf("Cannot open file \"%s\".\n", file);
-        return false;
-    }
-
-    char buf[256] = "\0";
-    bool first = true;
-    int pc = 0;
-    int ptr = 0;
-    while (fgets(buf, 256, fp) != NULL)
+    const unsigned char *p = (const unsigned char *)x;
+    unsigned long long h = 14695981039346656037ULL;
+    for (size_t i = 0; i < sizeof(double) * n; ++i)
     {
-        const char *p = buf;
-        while (*p != '\0')
-        {
-            if (' ' == *p || '\t' == *p || '\r' == *p || '\n' == *p) ++p;
-            else break;
-        }
-
-        if (*p == '\0') continue;
-        else if (*p == '%') continue;
-        else
-        {
-            if (first)
-            {
-                first = false;
-                int r, c, nz;
-                sscanf(p, "%d %d %d", &r, &c, &nz);
-                if (r != c)
-                {
-                    printf("Matrix is not square because row = %d and column = %d.\n", r, c);
-                    fclose(fp);
-                    return false;
-                }
-
-                n = r;
-                ap = new int [n + 1];
-                ai = new int [nz];
-                ax = new double [nz];
-                if (NULL == ap || NULL == ai || NULL == ax)
-                {
-                    printf("Malloc for matrix failed.\n");
-                    fclose(fp);
-                    return false;
-                }
-                ap[0] = 0;
-            }
-            else
-            {
-                int r, c;
-                double v;
-                sscanf(p, "%d %d %lf", &r, &c, &v);
-                --r;
-                --c;
-                ai[ptr] = r;
-                ax[ptr] = v;
-                if (c != pc)
-                {
-                    ap[c] = ptr;
-                    pc = c;
-                }
-                ++ptr;
-            }
-        }
+        h ^= p[i];
+        h *= 1099511628211ULL;
     }
-    ap[n] = ptr;
-
-    fclose(fp);
-    return true;
+    return h;
 }
 
-double L2NormOfResidual(const int n, const int ap[], const int ai[], const double ax[], const double x[], const double b[], bool row0_col1)
+/*
+* CompareChecksum: compares a checksum with the one saved in file by a previous run, or saves it if the file does not exist yet.
+* @return: 1 for equal, 0 for different, 2 for saved, <0 for file error
+*/
+int CompareChecksum(const char file[], unsigned long long sum)
 {
-    if (row0_col1)
-    {
-        double *bb = new double[n];
-        memcpy(bb, b, sizeof(double) * n);
-        for (int i = 0; i < n; ++i)
-        {
-            const double xx = x[i];
-            const int start = ap[i];
-            const int end = ap[i + 1];
-            for (int p = start; p < end; ++p)
-            {
-                bb[ai[p]] -= xx * ax[p];
-            }
-        }
-        double s = 0.;
-        for (int i = 0; i < n; ++i)
-        {
-            s += bb[i] * bb[i];
-        }
-        delete[]bb;
-        return sqrt(s);
-    }
-    else
+    FILE *fp = fopen(file, "r");
+    if (NULL != fp)
     {
-        double s = 0.;
-        for (int i = 0; i < n; ++i)
-        {
-            double r = 0.;
-            const int start = ap[i];
-            const int end = ap[i + 1];
-            for (int p = start; p < end; ++p)
-            {
-                const int j = ai[p];
-                r += ax[p] * x[j];
-            }
-            r -= b[i];
-            s += r * r;
-        }
-        return sqrt(s);
+        unsigned long long old;
+        const int k = fscanf(fp, "%llx", &old);
+        fclose(fp);
+        if (1 != k) return -2;
+        return (old == sum) ? 1 : 0;
     }
+    fp = fopen(file, "w");
+    if (NULL == fp) return -1;
+    fprintf(fp, "%016llx\n", sum);
+    fclose(fp);
+    return 2;
 }
 
 int main(int argc, char *argv[])
 {
     if (argc < 3)
     {
-        printf("Usage: benchmark <mtx file> <# of threads>\n");
+        printf("Usage: benchmark <mtx file> <# of threads> [deterministic [checksum file]]\n");
+        printf("The checksum file keeps the solution checksum of the first run, and later runs with the same matrix and thread number compare with it.\n");
         printf("Example: benchmark add20.mtx 4\n");
+        printf("Example: benchmark add20.mtx 4 deterministic add20.sum\n");
         return -1;
     }
 
@@ -171,7 +95,7 @@ int main(int argc, char *argv[])
     ICktSo instance = NULL;
     int *iparm;
     const long long *oparm;
-    int ret = CKTSO_CreateSolver(&instance, &iparm, &oparm);
+    int ret = CaptureCreateSolver(&instance, &iparm, &oparm); //set CKTSO_CAPTURE to record a trace for replay
     if (ret < 0)
     {
         printf("Failed to create solver instance, return code = %d.\n", ret);
@@ -183,16 +107,46 @@ int main(int argc, char *argv[])
     }
     iparm[0] = 1;
 
+    //Deterministic mode: the thread number is fixed to the requested value (no automatic control based on matrix features; control
+    //based on system workload, iparm[13], is off by default), so reruns use the same task-to-thread mapping. Compare the timing with the default mode to get its overhead
+    const bool deterministic = (argc > 3 && 0 == strcmp(argv[3], "deterministic"));
+    if (deterministic) iparm[9] = 0;
+    printf("Mode = %s.\n", deterministic ? "deterministic" : "default");
+
     instance->Analyze(false, n, ap, ai, ax, atoi(argv[2]));
     printf("Analysis time = %lld us.\n", oparm[0]);
 
+    //Residuals are computed by parallel SpMV on the analyzed arrays, in row mode and column (transposed) mode
+    ParallelMatVec<int> mvr, mvc;
+    mvr.Initialize(n, ap, ai, false, atoi(argv[2]));
+    mvc.Initialize(n, ap, ai, true, atoi(argv[2]));
+
+    //Reference solution for checking bitwise reproducibility of repeated factorizations
+    double *xref = new double [n + n];
+    double *xchk = xref + n;
+    if (NULL == xref)
+    {
+        printf("Malloc for reference solution failed.\n");
+        delete []ap;
+        delete []ai;
+        delete []ax;
+        delete []b;
+        instance->DestroySolver();
+        return -1;
+    }
+    instance->Factorize(ax, false);
+    instance->Solve(b, xref, false, false);
+
     long long min = LLONG_MAX;
     long long avg = 0;
+    int diff = 0;
     for (int i = 0; i < 100; ++i)
     {
         instance->Factorize(ax, true);
         if (oparm[1] < min) min = oparm[1];
         avg += oparm[1];
+        instance->Solve(b, xchk, false, false);
+        if (memcmp(xref, xchk, sizeof(double) * n) != 0) ++diff;
     }
     printf("Factorization average time = %lld us, min time = %lld us.\n", avg / 100, min);
 
@@ -203,8 +157,20 @@ int main(int argc, char *argv[])
         instance->Refactorize(ax);
         if (oparm[1] < min) min = oparm[1];
         avg += oparm[1];
+        instance->Solve(b, xchk, false, false);
+        if (memcmp(xref, xchk, sizeof(double) * n) != 0) ++diff;
     }
     printf("Refactorization average time = %lld us, min time = %lld us.\n", avg / 100, min);
+    printf("Bitwise reproducibility: %d of 200 factorizations in this run produced a different solution.\n", diff);
+    const unsigned long long sum = Checksum(xref, n);
+    if (argc > 4)
+    {
+        const int cmp = CompareChecksum(argv[4], sum);
+        if (cmp < 0) printf("Solution checksum = %016llx, cannot read or write checksum file \"%s\".\n", sum, argv[4]);
+        else if (2 == cmp) printf("Solution checksum = %016llx, saved to \"%s\" for later runs.\n", sum, argv[4]);
+        else printf("Solution checksum = %016llx, %s the previous run in \"%s\".\n", sum, cmp ? "same as" : "DIFFERENT from", argv[4]);
+    }
+    else printf("Solution checksum = %016llx (the check above covers this run only, pass a checksum file to compare across runs).\n", sum);
 
     min = LLONG_MAX;
     avg = 0;
@@ -216,7 +182,7 @@ int main(int argc, char *argv[])
     }
     printf("Solve average time = %lld us, min time = %lld us.\n", avg / 100, min);
 
-    printf("Residual = %g.\n", L2NormOfResidual(n, ap, ai, ax, x, b, false));
+    printf("Residual = %g.\n", mvr.Residual(ax, x, b, NULL, false, NULL));
 
     min = LLONG_MAX;
     avg = 0;
@@ -228,7 +194,7 @@ int main(int argc, char *argv[])
     }
     printf("Transposed solve average time = %lld us, min time = %lld us.\n", avg / 100, min);
 
-    printf("Residual = %g.\n", L2NormOfResidual(n, ap, ai, ax, x, b, true));
+    printf("Residual = %g.\n", mvc.Residual(ax, x, b, NULL, false, NULL));
 
     printf("NNZ(L) = %lld, NNZ(U) = %lld.\n", oparm[5], oparm[6]);
 
@@ -246,6 +212,7 @@ int main(int argc, char *argv[])
     delete []ai;
     delete []ax;
     delete []b;
+    delete []xref;
     instance->DestroySolver();
     return 0;
 }
@@ -9,148 +9,12 @@
 #include <math.h>
 #include <limits.h>
 #include "cktso.h"
+#include "mtxio.h"
+#include "matvec.h"
 #ifdef _MSC_VER
 #pragma comment(lib, "cktso.lib")
 #endif
 
-bool ReadMtxFile(const char file[], int &n, int *&ap, int *&ai, double *&ax)
-{
-    FILE *fp = fopen(file, "r");
-    if (NULL == fp)
-    {
-        printf("Cannot open file \"%s\".\n", file);
-        return false;
-    }
-
-    char buf[256] = "\0";
-    bool first = true;
-    int pc = 0;
-    int ptr = 0;
-    while (fgets(buf, 256, fp) != NULL)
-    {
-        const char *p = buf;
-        while (*p != '\0')
-        {
-            if (' ' == *p || '\t' == *p || '\r' == *p || '\n' == *p) ++p;
-            else break;
-        }
-
-        if (*p == '\0') continue;
-        else if (*p == '%') continue;
-        else
-        {
-            if (first)
-            {
-                first = false;
-                int r, c, nz;
-                sscanf(p, "%d %d %d", &r, &c, &nz);
-                if (r != c)
-                {
-                    printf("Matrix is not square because row = %d and column = %d.\n", r, c);
-                    fclose(fp);
-                    return false;
-                }
-
-                n = r;
-                ap = new int [n + 1];
-                ai = new int [nz];
-                ax = new double [nz];
-                if (NULL == ap || NULL == ai || NULL == ax)
-                {
-                    printf("Malloc for matrix failed.\n");
-                    fclose(fp);
-                    return false;
-                }
-                ap[0] = 0;
-            }
-            else
-            {
-                int r, c;
-                double v;
-                sscanf(p, "%d %d %lf", &r, &c, &v);
-                --r;
-                --c;
-                ai[ptr] = r;
-                ax[ptr] = v;
-                if (c != pc)
-                {
-                    ap[c] = ptr;
-                    pc = c;
-                }
-                ++ptr;
-            }
-        }
-    }
-    ap[n] = ptr;
-
-    fclose(fp);
-    return true;
-}
-
-typedef double complex[2];
-#define cmul(z, a, b) \
-{ \
-    const double a0 = (a)[0]; \
-    const double a1 = (a)[1]; \
-    const double b0 = (b)[0]; \
-    const double b1 = (b)[1]; \
-    (z)[0] = a0 * b0 - a1 * b1; \
-    (z)[1] = a0 * b1 + a1 * b0; \
-}
-
-double L2NormOfResidual(const int n, const int ap[], const int ai[], const complex ax[], const complex x[], const complex b[], bool row0_col1)
-{
-    if (row0_col1)
-    {
-        complex *bb = new complex[n];
-        memcpy(bb, b, sizeof(complex) * n);
-        for (int i = 0; i < n; ++i)
-        {
-            complex xx;
-            xx[0] = x[i][0];
-            xx[1] = x[i][1];
-            const int start = ap[i];
-            const int end = ap[i + 1];
-            for (int p = start; p < end; ++p)
-            {
-                complex t;
-                cmul(t, xx, ax[p]);
-                bb[ai[p]][0] -= t[0];
-                bb[ai[p]][1] -= t[1];
-            }
-        }
-        double s = 0.;
-        for (int i = 0; i < n; ++i)
-        {
-            s += bb[i][0] * bb[i][0] + bb[i][1] * bb[i][1];
-        }
-        delete[]bb;
-        return sqrt(s);
-    }
-    else
-    {
-        double s = 0.;
-        for (int i = 0; i < n; ++i)
-        {
-            complex r = { 0., 0. };
-            const int start = ap[i];
-            const int end = ap[i + 1];
-            for (int p = start; p < end; ++p)
-            {
-                const int j = ai[p];
-                complex t;
-                cmul(t, ax[p], x[j]);
-                r[0] += t[0];
-                r[1] += t[1];
-            }
-            r[0] -= b[i][0];
-            r[1] -= b[i][1];
-            s += r[0] * r[0] + r[1] * r[1];
-        }
-        return sqrt(s);
-    }
-}
-
 int main(int argc, char *argv[])
 {
     if (argc < 3)
@@ -165,7 +29,8 @@ int main(int argc, char *argv[])
     int *ai = NULL;
     double *ax = NULL;
     double *cx = NULL;
-    if (!ReadMtxFile(argv[1], n, ap, ai, ax))
+    bool is_complex;
+    if (!ReadMtxFile(argv[1], n, ap, ai, ax, &is_complex))
     {
         delete []ap;
         delete []ai;
@@ -173,20 +38,24 @@ int main(int argc, char *argv[])
         return -1;
     }
     const int nnz = ap[n];
-    cx = new double[nnz * 2];
-    if (NULL == cx)
+    if (is_complex) cx = ax;
+    else
     {
-        delete []ap;
-        delete []ai;
+        cx = new double[nnz * 2];
+        if (NULL == cx)
+        {
+            delete []ap;
+            delete []ai;
+            delete []ax;
+            return -1;
+        }
+        for (int i = 0; i < nnz; ++i)
+        {
+            cx[i + i] = ax[i];
+            cx[i + i + 1] = ax[i] * ((double)rand() / RAND_MAX - .5) * 2.;//randomly generate imaginary parts
+        }
         delete []ax;
-        return -1;
     }
-    for (int i = 0; i < nnz; ++i)
-    {
-        cx[i + i] = ax[i];
-        cx[i + i + 1] = ax[i] * ((double)rand() / RAND_MAX - .5) * 2.;//randomly generate imaginary parts
-    }
-    delete []ax;
 
     double *b = new double[n * 4];
     double *x = b + n * 2;
@@ -224,6 +93,11 @@ int main(int argc, char *argv[])
     instance->Analyze(true, n, ap, ai, cx, atoi(argv[2]));
     printf("Analysis time = %lld us.\n", oparm[0]);
 
+    //Residuals are computed by parallel SpMV on the analyzed arrays, in row mode and column (transposed) mode
+    ParallelMatVec<int> mvr, mvc;
+    mvr.Initialize(n, ap, ai, false, atoi(argv[2]));
+    mvc.Initialize(n, ap, ai, true, atoi(argv[2]));
+
     long long min = LLONG_MAX;
     long long avg = 0;
     for (int i = 0; i < 100; ++i)
@@ -254,7 +128,7 @@ int main(int argc, char *argv[])
     }
     printf("Solve average time = %lld us, min time = %lld us.\n", avg / 100, min);
 
-    printf("Residual = %g.\n", L2NormOfResidual(n, ap, ai, (complex *)cx, (complex *)x, (complex *)b, false));
+    printf("Residual = %g.\n", mvr.Residual(cx, x, b, NULL, true, NULL));
 
     min = LLONG_MAX;
     avg = 0;
@@ -266,7 +140,7 @@ int main(int argc, char *argv[])
     }
     printf("Transposed solve average time = %lld us, min time = %lld us.\n", avg / 100, min);
 
-    printf("Residual = %g.\n", L2NormOfResidual(n, ap, ai, (complex *)cx, (complex *)x, (complex *)b, true));
+    printf("Residual = %g.\n", mvc.Residual(cx, x, b, NULL, true, NULL));
 
     printf("NNZ(L) = %lld, NNZ(U) = %lld.\n", oparm[5], oparm[6]);
 
@@ -0,0 +1,520 @@
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS		1
+#define _CRT_NONSTDC_NO_WARNINGS	1
+#define _CRT_SECURE_NO_DEPRECATE	1
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#ifdef _MSC_VER
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+#include "cktso.h"
+#include "matvec.h"
+#include "mtxio.h"
+#ifdef _MSC_VER
+#pragma comment(lib, "cktso.lib")
+#endif
+
+/*
+* IsMatrixFile: Matrix Market (.mtx) or binary (.bin, see mtxio.h) file name.
+*/
+bool IsMatrixFile(const char name[])
+{
+    const size_t len = strlen(name);
+    return len > 4 && (0 == strcmp(name + len - 4, ".mtx") || 0 == strcmp(name + len - 4, ".bin"));
+}
+
+/*
+* ListMtxFiles: a single file, or all matrix files of a directory sorted by name (a .mtx file is skipped if its .bin copy exists).
+*/
+std::vector<std::string> ListMtxFiles(const char path[])
+{
+    std::vector<std::string> files;
+#ifdef _MSC_VER
+    const DWORD attr = GetFileAttributesA(path);
+    if (INVALID_FILE_ATTRIBUTES != attr && (attr & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        WIN32_FIND_DATAA fd;
+        const std::string pattern = std::string(path) + "\\*";
+        HANDLE h = FindFirstFileA(pattern.c_str(), &fd);
+        if (INVALID_HANDLE_VALUE != h)
+        {
+            do
+            {
+                if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && IsMatrixFile(fd.cFileName)) files.push_back(std::string(path) + "\\" + fd.cFileName);
+            } while (FindNextFileA(h, &fd));
+            FindClose(h);
+        }
+    }
+    else files.push_back(path);
+#else
+    struct stat st;
+    DIR *dir = (0 == stat(path, &st) && S_ISDIR(st.st_mode)) ? opendir(path) : NULL;
+    if (NULL != dir)
+    {
+        struct dirent *e;
+        while ((e = readdir(dir)) != NULL)
+        {
+            if (IsMatrixFile(e->d_name)) files.push_back(std::string(path) + "/" + e->d_name);
+        }
+        closedir(dir);
+    }
+    else files.push_back(path);
+#endif
+    std::sort(files.begin(), files.end());
+
+    //Prefer the binary copy when both X.bin and X.mtx exist
+    std::vector<std::string> out;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        const std::string &x = files[i];
+        if (x.size() > 4 && x.compare(x.size() - 4, 4, ".mtx") == 0
+            && std::binary_search(files.begin(), files.end(), x.substr(0, x.size() - 4) + ".bin")) continue;
+        out.push_back(x);
+    }
+    return out;
+}
+
+/*
+* ParseList: comma-separated integers, e.g. "1,2,4".
+*/
+std::vector<int> ParseList(const char s[])
+{
+    std::vector<int> v;
+    while (*s != '\0')
+    {
+        char *end;
+        const long x = strtol(s, &end, 10);
+        if (end == s) break;
+        v.push_back((int)x);
+        s = (',' == *end) ? end + 1 : end;
+    }
+    return v;
+}
+
+/*
+* Symmetry: calculates the fraction of off-diagonal nonzeros whose transposed entry exists (pattern symmetry) and whose transposed
+* entry also has the same value (numerical symmetry), and whether all diagonal entries are present and positive. Symmetric
+* matrices with positive diagonals (e.g., power grids and RC/RLC interconnects) are candidates for LDL^T/Cholesky factorization.
+*/
+void Symmetry(const int n, const int ap[], const int ai[], const double ax[], double *pattern, double *numeric, bool *posdiag)
+{
+    //Build the transposed matrix, then compare each row of A with the same row of A^T through a dense marker
+    const int nnz = ap[n];
+    int *tp = new int [n + 1];
+    int *ti = new int [nnz];
+    double *tx = new double [nnz];
+    int *mark = new int [n];
+    double *val = new double [n];
+    memset(tp, 0, sizeof(int) * (n + 1));
+    for (int p = 0; p < nnz; ++p) ++tp[ai[p] + 1];
+    for (int i = 0; i < n; ++i) tp[i + 1] += tp[i];
+    for (int i = 0; i < n; ++i)
+    {
+        for (int p = ap[i]; p < ap[i + 1]; ++p)
+        {
+            const int q = tp[ai[p]]++;
+            ti[q] = i;
+            tx[q] = ax[p];
+        }
+    }
+    for (int i = n; i > 0; --i) tp[i] = tp[i - 1];
+    tp[0] = 0;
+
+    long long offdiag = 0, pmatch = 0, nmatch = 0;
+    bool pd = true;
+    for (int i = 0; i < n; ++i) mark[i] = -1;
+    for (int i = 0; i < n; ++i)
+    {
+        bool diag = false;
+        for (int p = tp[i]; p < tp[i + 1]; ++p)
+        {
+            mark[ti[p]] = i;
+            val[ti[p]] = tx[p];
+        }
+        for (int p = ap[i]; p < ap[i + 1]; ++p)
+        {
+            const int j = ai[p];
+            if (j == i)
+            {
+                diag = true;
+                if (!(ax[p] > 0.)) pd = false;
+                continue;
+            }
+            ++offdiag;
+            if (mark[j] == i)
+            {
+                ++pmatch;
+                if (fabs(ax[p] - val[j]) <= 1e-12 * fabs(ax[p])) ++nmatch;
+            }
+        }
+        if (!diag) pd = false;
+    }
+    *pattern = (offdiag > 0) ? (double)pmatch / offdiag : 1.;
+    *numeric = (offdiag > 0) ? (double)nmatch / offdiag : 1.;
+    *posdiag = pd;
+
+    delete []tp;
+    delete []ti;
+    delete []tx;
+    delete []mark;
+    delete []val;
+}
+
+struct Timing
+{
+    long long min;
+    long long p50;
+    long long p90;
+    long long p99;
+    double avg;
+};
+
+/*
+* Summarize: min, nearest-rank percentiles and average of time samples (us).
+*/
+Timing Summarize(std::vector<long long> t)
+{
+    Timing s = { 0, 0, 0, 0, 0. };
+    if (t.empty()) return s;
+    std::sort(t.begin(), t.end());
+    const size_t m = t.size();
+    s.min = t[0];
+    s.p50 = t[(m * 50 + 99) / 100 - 1];
+    s.p90 = t[(m * 90 + 99) / 100 - 1];
+    s.p99 = t[(m * 99 + 99) / 100 - 1];
+    for (size_t i = 0; i < m; ++i) s.avg += (double)t[i];
+    s.avg /= m;
+    return s;
+}
+
+struct Result
+{
+    std::string matrix;
+    int n;
+    int nnz;
+    bool is_complex;
+    int ordering; //iparm[2]
+    int threads;
+    int ret; //<0 if failed
+    long long analyze_us;
+    Timing factor;
+    Timing refactor;
+    Timing solve;
+    long long factor_flops;
+    long long solve_flops;
+    long long nnz_lu; //nnz(L)+nnz(U)
+    long long supernodes; //oparm[7], the dense supernodal kernels dominate the GFLOP/s on large supernodes
+    long long mem; //oparm[12]
+    long long max_mem; //oparm[13]
+    double residual;
+    double efficiency; //refactorization speedup over the smallest thread count, divided by the thread ratio
+    double pattern_symmetry; //of the matrix, the same for all configurations (see Symmetry), -1 for complex values
+    double numeric_symmetry;
+    bool positive_diagonal;
+};
+
+/*
+* Run: benchmarks one configuration; all timings come from the library's microsecond timer (oparm).
+*/
+Result Run(const std::string &name, int n, const int ap[], const int ai[], const double ax[], bool is_complex, int ordering, int threads, int reps)
+{
+    Result r = Result(); //zero all fields
+    r.matrix = name;
+    r.n = n;
+    r.nnz = ap[n];
+    r.is_complex = is_complex;
+    r.ordering = ordering;
+    r.threads = threads;
+    r.efficiency = -1.;
+
+    const int w = is_complex ? 2 : 1;
+    std::vector<double> b((size_t)n * w), x((size_t)n * w, 0.);
+    for (size_t i = 0; i < b.size(); ++i) b[i] = (double)rand() / RAND_MAX * 100.;
+
+    ICktSo inst = NULL;
+    int *iparm;
+    const long long *oparm;
+    r.ret = CKTSO_CreateSolver(&inst, &iparm, &oparm);
+    if (r.ret < 0) return r;
+    iparm[0] = 1;
+    iparm[2] = ordering;
+    iparm[9] = 0; //run exactly the requested thread number
+    r.ret = inst->Analyze(is_complex, n, ap, ai, ax, threads);
+    if (r.ret < 0)
+    {
+        inst->DestroySolver();
+        return r;
+    }
+    r.analyze_us = oparm[0];
+
+    //Only the repetitions that succeeded are summarized, a phase after a failure keeps zero timings
+    std::vector<long long> t;
+    t.reserve(reps);
+    for (int i = 0; i < reps && r.ret >= 0; ++i)
+    {
+        r.ret = inst->Factorize(ax, false);
+        if (r.ret >= 0) t.push_back(oparm[1]);
+    }
+    r.factor = Summarize(t);
+    t.clear();
+    for (int i = 0; i < reps && r.ret >= 0; ++i)
+    {
+        r.ret = inst->Refactorize(ax);
+        if (r.ret >= 0) t.push_back(oparm[1]);
+    }
+    r.refactor = Summarize(t);
+    t.clear();
+    for (int i = 0; i < reps && r.ret >= 0; ++i)
+    {
+        r.ret = inst->Solve(&b[0], &x[0], false, false);
+        if (r.ret >= 0) t.push_back(oparm[2]);
+    }
+    r.solve = Summarize(t);
+    if (r.ret >= 0)
+    {
+        //Statistics needs factors from a pivoting factorization, which Refactorize keeps
+        inst->Statistics(&r.factor_flops, &r.solve_flops, NULL, NULL, false, -1, false);
+        r.nnz_lu = oparm[5] + oparm[6];
+        r.supernodes = oparm[7];
+        r.mem = oparm[12];
+        r.max_mem = oparm[13];
+        ParallelMatVec<int> mv;
+        mv.Initialize(n, ap, ai, false, threads);
+        r.residual = mv.Residual(ax, &x[0], &b[0], NULL, is_complex, NULL);
+    }
+    inst->DestroySolver();
+    return r;
+}
+
+double Rate(long long flops, long long us)
+{
+    return (us > 0) ? flops * 1e-3 / us : 0.; //flops per us = MFLOP/s, returned in GFLOP/s
+}
+
+void WriteCsv(FILE *fp, const std::vector<Result> &res)
+{
+    fprintf(fp, "matrix,n,nnz,type,ordering,threads,ret,analyze_us,factor_min_us,factor_p50_us,factor_p90_us,factor_p99_us,"
+        "refactor_min_us,refactor_p50_us,refactor_p90_us,refactor_p99_us,solve_min_us,solve_p50_us,solve_p90_us,solve_p99_us,"
+        "factor_gflops,refactor_gflops,solve_gflops,nnz_lu,supernodes,mem_bytes,max_mem_bytes,residual,parallel_efficiency,pattern_symmetry,numeric_symmetry,"
+        "positive_diagonal\n");
+    for (size_t k = 0; k < res.size(); ++k)
+    {
+        const Result &r = res[k];
+        fprintf(fp, "%s,%d,%d,%s,%d,%d,%d,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%g,%g,%g,%lld,%lld,%lld,%lld,%g,%g,%g,%g,%d\n",
+            r.matrix.c_str(), r.n, r.nnz, r.is_complex ? "complex" : "real", r.ordering, r.threads, r.ret, r.analyze_us,
+            r.factor.min, r.factor.p50, r.factor.p90, r.factor.p99, r.refactor.min, r.refactor.p50, r.refactor.p90, r.refactor.p99,
+            r.solve.min, r.solve.p50, r.solve.p90, r.solve.p99, Rate(r.factor_flops, r.factor.p50), Rate(r.factor_flops, r.refactor.p50),
+            Rate(r.solve_flops, r.solve.p50), r.nnz_lu, r.supernodes, r.mem, r.max_mem, r.residual, r.efficiency, r.pattern_symmetry, r.numeric_symmetry,
+            r.positive_diagonal ? 1 : 0);
+    }
+}
+
+void WriteTiming(FILE *fp, const char name[], const Timing &t)
+{
+    fprintf(fp, "\"%s\": {\"min\": %lld, \"p50\": %lld, \"p90\": %lld, \"p99\": %lld, \"avg\": %.1f}", name, t.min, t.p50, t.p90, t.p99, t.avg);
+}
+
+void WriteJson(FILE *fp, const std::vector<Result> &res)
+{
+    fprintf(fp, "[\n");
+    for (size_t k = 0; k < res.size(); ++k)
+    {
+        const Result &r = res[k];
+        std::string m;
+        for (size_t i = 0; i < r.matrix.size(); ++i)
+        {
+            if ('"' == r.matrix[i] || '\\' == r.matrix[i]) m += '\\';
+            m += r.matrix[i];
+        }
+        fprintf(fp, "  {\"matrix\": \"%s\", \"n\": %d, \"nnz\": %d, \"type\": \"%s\", \"ordering\": %d, \"threads\": %d, \"ret\": %d, \"analyze_us\": %lld, ",
+            m.c_str(), r.n, r.nnz, r.is_complex ? "complex" : "real", r.ordering, r.threads, r.ret, r.analyze_us);
+        WriteTiming(fp, "factor_us", r.factor);
+        fprintf(fp, ", ");
+        WriteTiming(fp, "refactor_us", r.refactor);
+        fprintf(fp, ", ");
+        WriteTiming(fp, "solve_us", r.solve);
+        fprintf(fp, ", \"factor_gflops\": %g, \"refactor_gflops\": %g, \"solve_gflops\": %g, \"nnz_lu\": %lld, \"supernodes\": %lld, \"mem_bytes\": %lld, \"max_mem_bytes\": %lld, "
+            "\"residual\": %g, \"parallel_efficiency\": %g, \"pattern_symmetry\": %g, \"numeric_symmetry\": %g, \"positive_diagonal\": %s}%s\n",
+            Rate(r.factor_flops, r.factor.p50), Rate(r.factor_flops, r.refactor.p50), Rate(r.solve_flops, r.solve.p50), r.nnz_lu, r.supernodes, r.mem,
+            r.max_mem, r.residual, r.efficiency, r.pattern_symmetry, r.numeric_symmetry, r.positive_diagonal ? "true" : "false", k + 1 < res.size() ? "," : "");
+    }
+    fprintf(fp, "]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: benchmark_suite <matrix file or directory> [options]\n");
+        printf("Matrix files are Matrix Market (.mtx, any entry order, general/symmetric/hermitian, real/complex/pattern) or binary (.bin).\n");
+        printf("Options:\n");
+        printf("  -t <list>   thread numbers, e.g. 1,2,4 [default 1]\n");
+        printf("  -o <list>   ordering methods iparm[2], e.g. 0,1,11 [default 0]\n");
+        printf("  -m <mode>   real, complex or both [default real]\n");
+        printf("  -r <reps>   repetitions of each phase [default 20]\n");
+        printf("  -j <file>   write results as JSON\n");
+        printf("  -c <file>   write results as CSV\n");
+        printf("  -s          save a binary copy (.bin) of each .mtx file for fast reloads\n");
+        printf("Example: benchmark_suite matrices -t 1,2,4 -o 0,11 -m both -j results.json\n");
+        return -1;
+    }
+
+    std::vector<int> threads(1, 1), orderings(1, 0);
+    bool do_real = true, do_complex = false;
+    int reps = 20;
+    const char *json = NULL, *csv = NULL;
+    bool save = false;
+    for (int a = 2; a < argc; a += 2)
+    {
+        if (0 == strcmp(argv[a], "-s"))
+        {
+            save = true;
+            --a;
+            continue;
+        }
+        if (a + 1 >= argc)
+        {
+            printf("Missing value of option \"%s\".\n", argv[a]);
+            return -1;
+        }
+        if (0 == strcmp(argv[a], "-t")) threads = ParseList(argv[a + 1]);
+        else if (0 == strcmp(argv[a], "-o")) orderings = ParseList(argv[a + 1]);
+        else if (0 == strcmp(argv[a], "-m"))
+        {
+            do_real = (0 != strcmp(argv[a + 1], "complex"));
+            do_complex = (0 != strcmp(argv[a + 1], "real"));
+        }
+        else if (0 == strcmp(argv[a], "-r")) reps = atoi(argv[a + 1]);
+        else if (0 == strcmp(argv[a], "-j")) json = argv[a + 1];
+        else if (0 == strcmp(argv[a], "-c")) csv = argv[a + 1];
+        else
+        {
+            printf("Unknown option \"%s\".\n", argv[a]);
+            return -1;
+        }
+    }
+    if (threads.empty() || orderings.empty() || reps <= 0)
+    {
+        printf("Invalid thread list, ordering list or repetitions.\n");
+        return -1;
+    }
+    std::sort(threads.begin(), threads.end());
+
+    const std::vector<std::string> files = ListMtxFiles(argv[1]);
+    std::vector<Result> res;
+    printf("%-24s %-7s %4s %3s %12s %12s %12s %12s %10s %7s %9s %6s\n", "matrix", "type", "ord", "thr", "analyze(us)", "factor p50",
+        "refactor p50", "solve p50", "refac GF/s", "snodes", "max MB", "eff");
+    for (size_t f = 0; f < files.size(); ++f)
+    {
+        int n;
+        std::vector<int> ap, ai;
+        std::vector<double> ax, cx;
+        bool is_complex;
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        const int ret = LoadMatrix(files[f].c_str(), n, ap, ai, ax, is_complex, 0);
+        const double load_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        if (ret < 0)
+        {
+            printf("Failed to load \"%s\", return code = %d.\n", files[f].c_str(), ret);
+            continue;
+        }
+        const int nnz = ap[n];
+        std::string name = files[f];
+        const size_t slash = name.find_last_of("/\\");
+        if (std::string::npos != slash) name = name.substr(slash + 1);
+        double psym = -1., nsym = -1.; //not computed for complex values
+        bool posdiag = false;
+        if (!is_complex) Symmetry(n, &ap[0], &ai[0], nnz ? &ax[0] : NULL, &psym, &nsym, &posdiag);
+        printf("Loaded %s in %.3f s.\n", name.c_str(), load_s);
+        if (!is_complex) printf("Pattern symmetry = %g, numerical symmetry = %g, positive diagonal = %s.\n", psym, nsym, posdiag ? "yes" : "no");
+        if (save && files[f].size() > 4 && 0 == files[f].compare(files[f].size() - 4, 4, ".mtx"))
+        {
+            const std::string bin = files[f].substr(0, files[f].size() - 4) + ".bin";
+            if (SaveBinary(bin.c_str(), n, &ap[0], &ai[0], nnz ? &ax[0] : NULL, is_complex) < 0) printf("Cannot write file \"%s\".\n", bin.c_str());
+        }
+
+        //Complex values: the real parts are the matrix values, imaginary parts are generated as in benchmark_complex.cpp.
+        //Complex files are benchmarked as complex only
+        if (is_complex) cx.swap(ax);
+        else
+        {
+            srand(1);
+            cx.resize((size_t)nnz * 2);
+            for (int i = 0; i < nnz; ++i)
+            {
+                cx[i + i] = ax[i];
+                cx[i + i + 1] = ax[i] * ((double)rand() / RAND_MAX - .5) * 2.;
+            }
+        }
+
+        for (int mode = 0; mode < 2; ++mode)
+        {
+            if ((0 == mode && (!do_real || is_complex)) || (1 == mode && !do_complex && !is_complex)) continue;
+            for (size_t o = 0; o < orderings.size(); ++o)
+            {
+                const size_t first = res.size();
+                for (size_t t = 0; t < threads.size(); ++t)
+                {
+                    srand(2);
+                    res.push_back(Run(name, n, &ap[0], &ai[0], 1 == mode ? &cx[0] : &ax[0], 1 == mode, orderings[o], threads[t], reps));
+                    Result &r = res.back();
+                    r.pattern_symmetry = psym;
+                    r.numeric_symmetry = nsym;
+                    r.positive_diagonal = posdiag;
+                    const Result &base = res[first];
+                    if (r.ret >= 0 && base.ret >= 0 && r.refactor.p50 > 0)
+                    {
+                        r.efficiency = (double)base.refactor.p50 * base.threads / ((double)r.refactor.p50 * r.threads);
+                    }
+                    if (r.ret < 0)
+                    {
+                        printf("%-24s %-7s %4d %3d failed, return code = %d.\n", name.c_str(), 1 == mode ? "complex" : "real", r.ordering, r.threads, r.ret);
+                        continue;
+                    }
+                    printf("%-24s %-7s %4d %3d %12lld %12lld %12lld %12lld %10.3f %7lld %9.1f %6.2f\n", name.c_str(), 1 == mode ? "complex" : "real",
+                        r.ordering, r.threads, r.analyze_us, r.factor.p50, r.refactor.p50, r.solve.p50, Rate(r.factor_flops, r.refactor.p50),
+                        r.supernodes, r.max_mem / 1048576., r.efficiency);
+                }
+            }
+        }
+    }
+    if (res.empty())
+    {
+        printf("No matrix was benchmarked.\n");
+        return -1;
+    }
+
+    if (NULL != json)
+    {
+        FILE *fp = fopen(json, "w");
+        if (NULL == fp) printf("Cannot write file \"%s\".\n", json);
+        else
+        {
+            WriteJson(fp, res);
+            fclose(fp);
+        }
+    }
+    if (NULL != csv)
+    {
+        FILE *fp = fopen(csv, "w");
+        if (NULL == fp) printf("Cannot write file \"%s\".\n", csv);
+        else
+        {
+            WriteCsv(fp, res);
+            fclose(fp);
+        }
+    }
+    return 0;
+}
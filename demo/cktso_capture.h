@@ -0,0 +1,380 @@
+/*
+* Capture mode for offline performance analysis of ICktSo.
+* CaptureCreateSolver is a drop-in replacement of CKTSO_CreateSolver. When the environment variable CKTSO_CAPTURE is set to a
+* file name (or a file name is given), the returned instance forwards every call to a real solver instance and appends it to a
+* compact binary trace: the pattern and values passed to Analyze, the input parameters at Analyze and Factorize, the call sequence
+* with return codes and wall times, and the values and right-hand-sides of the first calls of each kind (CKTSO_CAPTURE_VALUES,
+* default 8). Later calls record only their timings, and are replayed with the last recorded values.
+* The trace is flushed after every call, so it stays usable if the application aborts. Run "replay <trace file>" to rerun it.
+* Only the C++ interface is captured; calls through the C functions go to the library directly.
+*/
+
+#ifndef __CKTSO_CAPTURE__
+#define __CKTSO_CAPTURE__
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "cktso.h"
+
+#define CKTSO_TRACE_MAGIC       "CKTSOTRC"
+#define CKTSO_TRACE_VERSION     1
+#define CKTSO_TRACE_IPARM       14 /*iparm[0]~iparm[13] are snapshotted*/
+
+/*
+* Trace layout (native byte order):
+* header: char magic[8], int32 version, int32 # of iparm entries in snapshots
+* record: int32 op, int32 return code, int64 wall time (ns), int64 payload bytes, payload
+* payloads (values are present only if the has_values/has_b flag is 1):
+*   ANALYZE:                int32 is_complex, n, threads, has_values, iparm[], ap[n+1], ai[nnz], ax[nnz]
+*   FACTORIZE:              int32 fast, has_values, iparm[], ax[nnz]
+*   REFACTORIZE:            int32 has_values, ax[nnz]
+*   SOLVE:                  int32 force_seq, row0_column1, has_b, b[n]
+*   SOLVEMV:                int64 nrhs, int32 row0_column1, has_b, b[n*nrhs] (packed)
+*   FACTORIZE_AND_SOLVE,
+*   REFACTORIZE_AND_SOLVE:  int32 row0_column1, has_values, ax[nnz], b[n]
+*   SORT_FACTORS:           int32 also_sort_values
+*   STATISTICS:             int32 row0_column1, scaling, fuse_mac
+*   others:                 none
+* Complex values take two doubles per entry.
+*/
+enum
+{
+    CKTSO_TRACE_ANALYZE = 1,
+    CKTSO_TRACE_FACTORIZE,
+    CKTSO_TRACE_REFACTORIZE,
+    CKTSO_TRACE_SOLVE,
+    CKTSO_TRACE_SOLVEMV,
+    CKTSO_TRACE_SORT_FACTORS,
+    CKTSO_TRACE_STATISTICS,
+    CKTSO_TRACE_CLEAN_UP_GARBAGE,
+    CKTSO_TRACE_DETERMINANT,
+    CKTSO_TRACE_FACTORIZE_AND_SOLVE,
+    CKTSO_TRACE_REFACTORIZE_AND_SOLVE,
+    CKTSO_TRACE_EXTRACT_FACTORS,
+    CKTSO_TRACE_OPS
+};
+
+class CaptureSolver final : public __cktso_dummy
+{
+public:
+    CaptureSolver(ICktSo inner, const int *iparm, FILE *fp, int sample) : inner(inner), iparm(iparm), fp(fp), sample(sample),
+        is_complex(false), n(0), nnz(0), start(0), kept(NULL), kept_bytes(0)
+    {
+        memset(count, 0, sizeof(count));
+        const int version = CKTSO_TRACE_VERSION;
+        const int np = CKTSO_TRACE_IPARM;
+        fwrite(CKTSO_TRACE_MAGIC, 1, 8, fp);
+        fwrite(&version, sizeof(int), 1, fp);
+        fwrite(&np, sizeof(int), 1, fp);
+        fflush(fp);
+    }
+
+    virtual int _CDECL_ DestroySolver()
+    {
+        const int ret = inner->DestroySolver();
+        fclose(fp);
+        delete this;
+        return ret;
+    }
+
+    virtual int _CDECL_ Analyze(bool is_complex, int n, const int ap[], const int ai[], const double ax[], int threads)
+    {
+        Begin();
+        const int ret = inner->Analyze(is_complex, n, ap, ai, ax, threads);
+        RecordAnalyze(ret, is_complex, n, ap, ai, ax, threads);
+        return ret;
+    }
+
+    virtual int _CDECL_ Factorize(const double ax[], bool fast)
+    {
+        Begin();
+        const int ret = inner->Factorize(ax, fast);
+        const int vals = Sampled(CKTSO_TRACE_FACTORIZE) && ax != NULL;
+        Head(CKTSO_TRACE_FACTORIZE, ret, 2 * sizeof(int) + CKTSO_TRACE_IPARM * sizeof(int) + (vals ? Values() : 0));
+        Int(fast);
+        Int(vals);
+        Iparm();
+        if (vals) fwrite(ax, 1, Values(), fp);
+        fflush(fp);
+        return ret;
+    }
+
+    virtual int _CDECL_ Refactorize(const double ax[])
+    {
+        Begin();
+        const int ret = inner->Refactorize(ax);
+        const int vals = Sampled(CKTSO_TRACE_REFACTORIZE) && ax != NULL;
+        Head(CKTSO_TRACE_REFACTORIZE, ret, sizeof(int) + (vals ? Values() : 0));
+        Int(vals);
+        if (vals) fwrite(ax, 1, Values(), fp);
+        fflush(fp);
+        return ret;
+    }
+
+    virtual int _CDECL_ Solve(const double b[], double x[], bool force_seq, bool row0_column1)
+    {
+        int rhs = Sampled(CKTSO_TRACE_SOLVE) && b != NULL;
+        if (rhs && b == x && !Keep(b, Vector())) rhs = 0; //x overwrites b
+        Begin();
+        const int ret = inner->Solve(b, x, force_seq, row0_column1);
+        const long long ns = Elapsed();
+        Head(CKTSO_TRACE_SOLVE, ret, 3 * sizeof(int) + (rhs ? Vector() : 0), ns);
+        Int(force_seq);
+        Int(row0_column1);
+        Int(rhs);
+        if (rhs) fwrite(b == x ? kept : b, 1, Vector(), fp);
+        fflush(fp);
+        return ret;
+    }
+
+    virtual int _CDECL_ SolveMV(size_t nrhs, const double b[], size_t ld_b, double x[], size_t ld_x, bool row0_column1)
+    {
+        const size_t ld = (ld_b == 0 ? (size_t)n : ld_b) * (is_complex ? 2 : 1);
+        const int packed = Sampled(CKTSO_TRACE_SOLVEMV) && b != NULL && Keep(NULL, Vector() * nrhs);
+        if (packed)
+        {
+            //Pack before solving, x may overwrite b
+            for (size_t k = 0; k < nrhs; ++k) memcpy((char *)kept + k * Vector(), b + k * ld, Vector());
+        }
+        Begin();
+        const int ret = inner->SolveMV(nrhs, b, ld_b, x, ld_x, row0_column1);
+        const long long ns = Elapsed();
+        Head(CKTSO_TRACE_SOLVEMV, ret, sizeof(long long) + 2 * sizeof(int) + (packed ? Vector() * nrhs : 0), ns);
+        const long long nr = (long long)nrhs;
+        fwrite(&nr, sizeof(long long), 1, fp);
+        Int(row0_column1);
+        Int(packed);
+        if (packed) fwrite(kept, 1, Vector() * nrhs, fp);
+        fflush(fp);
+        return ret;
+    }
+
+    virtual int _CDECL_ SortFactors(bool also_sort_values)
+    {
+        Begin();
+        const int ret = inner->SortFactors(also_sort_values);
+        Head(CKTSO_TRACE_SORT_FACTORS, ret, sizeof(int));
+        Int(also_sort_values);
+        fflush(fp);
+        return ret;
+    }
+
+    virtual int _CDECL_ Statistics(long long *factor_flops, long long *solve_flops, long long *factor_mem, long long *solve_mem,
+        bool row0_column1, char scaling, bool fuse_mac)
+    {
+        Begin();
+        const int ret = inner->Statistics(factor_flops, solve_flops, factor_mem, solve_mem, row0_column1, scaling, fuse_mac);
+        Head(CKTSO_TRACE_STATISTICS, ret, 3 * sizeof(int));
+        Int(row0_column1);
+        Int(scaling);
+        Int(fuse_mac);
+        fflush(fp);
+        return ret;
+    }
+
+    virtual int _CDECL_ CleanUpGarbage()
+    {
+        Begin();
+        const int ret = inner->CleanUpGarbage();
+        Head(CKTSO_TRACE_CLEAN_UP_GARBAGE, ret, 0);
+        fflush(fp);
+        return ret;
+    }
+
+    virtual int _CDECL_ Determinant(double *mantissa, double *exponent)
+    {
+        Begin();
+        const int ret = inner->Determinant(mantissa, exponent);
+        Head(CKTSO_TRACE_DETERMINANT, ret, 0);
+        fflush(fp);
+        return ret;
+    }
+
+    virtual int _CDECL_ FactorizeAndSolve(const double ax[], const double b[], double x[], bool row0_column1)
+    {
+        return CombinedSolve(CKTSO_TRACE_FACTORIZE_AND_SOLVE, ax, b, x, row0_column1);
+    }
+
+    virtual int _CDECL_ RefactorizeAndSolve(const double ax[], const double b[], double x[], bool row0_column1)
+    {
+        return CombinedSolve(CKTSO_TRACE_REFACTORIZE_AND_SOLVE, ax, b, x, row0_column1);
+    }
+
+    virtual int _CDECL_ Analyze2(bool is_complex, int n, const int ap[], const int ai[], const double ax[], int threads,
+        int rperm[], int cperm[], double rscale[], double cscale[])
+    {
+        Begin();
+        const int ret = inner->Analyze2(is_complex, n, ap, ai, ax, threads, rperm, cperm, rscale, cscale);
+        RecordAnalyze(ret, is_complex, n, ap, ai, ax, threads);
+        return ret;
+    }
+
+    virtual int _CDECL_ ExtractFactors(size_t lp[], int li[], double lx[], size_t up[], int ui[], double ux[],
+        int rperm[], int cperm[], double rscale[], double cscale[])
+    {
+        Begin();
+        const int ret = inner->ExtractFactors(lp, li, lx, up, ui, ux, rperm, cperm, rscale, cscale);
+        Head(CKTSO_TRACE_EXTRACT_FACTORS, ret, 0);
+        fflush(fp);
+        return ret;
+    }
+
+private:
+    ~CaptureSolver()
+    {
+        free(kept);
+    }
+
+    void Begin()
+    {
+        start = Now();
+    }
+
+    long long Elapsed() const
+    {
+        return Now() - start;
+    }
+
+    static long long Now()
+    {
+        return (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    //Values of the first calls of each kind are recorded, see CKTSO_CAPTURE_VALUES
+    bool Sampled(int op)
+    {
+        if (count[op] >= sample) return false;
+        ++count[op];
+        return true;
+    }
+
+    size_t Values() const
+    {
+        return nnz * (is_complex ? 2 : 1) * sizeof(double);
+    }
+
+    size_t Vector() const
+    {
+        return (size_t)n * (is_complex ? 2 : 1) * sizeof(double);
+    }
+
+    void Head(int op, int ret, size_t bytes, long long ns = -1)
+    {
+        if (ns < 0) ns = Elapsed();
+        const long long len = (long long)bytes;
+        fwrite(&op, sizeof(int), 1, fp);
+        fwrite(&ret, sizeof(int), 1, fp);
+        fwrite(&ns, sizeof(long long), 1, fp);
+        fwrite(&len, sizeof(long long), 1, fp);
+    }
+
+    void Int(int v)
+    {
+        fwrite(&v, sizeof(int), 1, fp);
+    }
+
+    void Iparm()
+    {
+        int snap[CKTSO_TRACE_IPARM] = { 0 };
+        if (iparm != NULL) memcpy(snap, iparm, sizeof(snap));
+        fwrite(snap, sizeof(int), CKTSO_TRACE_IPARM, fp);
+    }
+
+    bool Keep(const double src[], size_t bytes)
+    {
+        if (bytes > kept_bytes)
+        {
+            void *p = realloc(kept, bytes);
+            if (NULL == p) return false;
+            kept = (double *)p;
+            kept_bytes = bytes;
+        }
+        if (src != NULL) memcpy(kept, src, bytes);
+        return true;
+    }
+
+    void RecordAnalyze(int ret, bool cplx, int dim, const int ap[], const int ai[], const double ax[], int threads)
+    {
+        const long long ns = Elapsed();
+        is_complex = cplx;
+        n = dim;
+        nnz = (dim > 0 && ap != NULL) ? (size_t)ap[dim] : 0;
+        memset(count, 0, sizeof(count)); //sample the values of each analyzed matrix again
+        const int pattern = (nnz > 0 && ai != NULL) ? 1 : 0;
+        const int vals = (pattern && ax != NULL) ? 1 : 0;
+        const size_t bytes = 4 * sizeof(int) + CKTSO_TRACE_IPARM * sizeof(int)
+            + (pattern ? ((size_t)dim + 1 + nnz) * sizeof(int) : 0) + (vals ? Values() : 0);
+        Head(CKTSO_TRACE_ANALYZE, ret, bytes, ns);
+        Int(cplx);
+        Int(pattern ? dim : 0);
+        Int(threads);
+        Int(vals);
+        Iparm();
+        if (pattern)
+        {
+            fwrite(ap, sizeof(int), (size_t)dim + 1, fp);
+            fwrite(ai, sizeof(int), nnz, fp);
+        }
+        if (vals) fwrite(ax, 1, Values(), fp);
+        fflush(fp);
+    }
+
+    int CombinedSolve(int op, const double ax[], const double b[], double x[], bool row0_column1)
+    {
+        int vals = Sampled(op) && ax != NULL && b != NULL;
+        if (vals && b == x && !Keep(b, Vector())) vals = 0;
+        Begin();
+        const int ret = (CKTSO_TRACE_FACTORIZE_AND_SOLVE == op) ? inner->FactorizeAndSolve(ax, b, x, row0_column1)
+            : inner->RefactorizeAndSolve(ax, b, x, row0_column1);
+        const long long ns = Elapsed();
+        Head(op, ret, 2 * sizeof(int) + (vals ? Values() + Vector() : 0), ns);
+        Int(row0_column1);
+        Int(vals);
+        if (vals)
+        {
+            fwrite(ax, 1, Values(), fp);
+            fwrite(b == x ? kept : b, 1, Vector(), fp);
+        }
+        fflush(fp);
+        return ret;
+    }
+
+    ICktSo inner;
+    const int *iparm;
+    FILE *fp;
+    int sample;
+    bool is_complex;
+    int n;
+    size_t nnz;
+    long long start;
+    int count[CKTSO_TRACE_OPS];
+    double *kept; //copy of b when it is overwritten by x
+    size_t kept_bytes;
+};
+
+/*
+* CaptureCreateSolver: same as CKTSO_CreateSolver, but returns a capturing instance if file is not NULL or the environment
+* variable CKTSO_CAPTURE is set. If the trace file cannot be created, the real instance is returned and capture is off.
+* @file: trace file name, NULL to use CKTSO_CAPTURE
+*/
+inline int CaptureCreateSolver(ICktSo *inst, int **iparm, const long long **oparm, const char *file = NULL)
+{
+    int *ip = NULL;
+    int ret = CKTSO_CreateSolver(inst, &ip, oparm);
+    if (iparm != NULL) *iparm = ip;
+    if (ret < 0) return ret;
+
+    if (NULL == file) file = getenv("CKTSO_CAPTURE");
+    if (NULL == file || '\0' == file[0]) return ret;
+    FILE *fp = fopen(file, "wb");
+    if (NULL == fp) return ret;
+    int sample = 8;
+    const char *s = getenv("CKTSO_CAPTURE_VALUES");
+    if (s != NULL && s[0] != '\0') sample = atoi(s);
+    CaptureSolver *cap = new CaptureSolver(*inst, ip, fp, sample);
+    *inst = cap;
+    return ret;
+}
+
+#endif
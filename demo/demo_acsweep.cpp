@@ -0,0 +1,255 @@
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS		1
+#define _CRT_NONSTDC_NO_WARNINGS	1
+#define _CRT_SECURE_NO_DEPRECATE	1
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include "cktso.h"
+#include "mtxio.h"
+#include "matvec.h"
+#ifdef _MSC_VER
+#pragma comment(lib, "cktso.lib")
+#endif
+
+/*
+* ACSweep: solves (G+jwC)x=b at many frequencies, where G and C share one real-valued pattern (row mode) and are given separately.
+* Frequency points are split into contiguous batches, one per solver instance, and the batches run in parallel with one thread per
+* instance: for AC sweeps of circuit matrices, parallelism across frequencies scales much better than parallelism inside one small
+* factorization. Each instance assembles the interleaved complex values itself from G and C, so no complex copy of the matrix is
+* kept by the caller. Neighbouring frequencies have similar values, so after the first point of a batch, fast factorization is used
+* (it reuses the pivots of the previous frequency but still checks them).
+* The library cannot share symbolic data between instances, so every instance analyzes the same pattern and keeps its own symbolic
+* data and factors: memory grows linearly with the # of instances. The ordering search (iparm[2]=0 tries every method) is done once
+* by the first instance, and the others run only the selected method (oparm[8]), which makes their analysis several times cheaper
+* (AnalyzeTime).
+*/
+class ACSweep
+{
+public:
+    ACSweep() : n(0), ap(NULL), ai(NULL), first_us(0), other_us(0)
+    {
+    }
+
+    ~ACSweep()
+    {
+        for (size_t i = 0; i < inst.size(); ++i) inst[i]->DestroySolver();
+    }
+
+    /*
+    * Initialize: creates and analyzes the solver instances.
+    * @g: conductance values (length ap[n])
+    * @c: capacitance values (length ap[n])
+    * @instances: # of solver instances, i.e., # of frequency batches solved in parallel (0=all hardware threads)
+    */
+    int Initialize(int n_, const int ap_[], const int ai_[], const double g[], const double c[], int instances)
+    {
+        n = n_;
+        ap = ap_;
+        ai = ai_;
+        if (instances <= 0) instances = (int)std::thread::hardware_concurrency();
+        if (instances <= 0) instances = 1;
+
+        //Analyze with the values at w=1, which have the magnitudes of both G and C
+        const int nnz = ap[n];
+        std::vector<double> ax((size_t)nnz * 2);
+        for (int p = 0; p < nnz; ++p)
+        {
+            ax[p + p] = g[p];
+            ax[p + p + 1] = c[p];
+        }
+        int method = 0;
+        first_us = other_us = 0;
+        for (int k = 0; k < instances; ++k)
+        {
+            ICktSo s = NULL;
+            int *iparm;
+            const long long *oparm;
+            int ret = CKTSO_CreateSolver(&s, &iparm, &oparm);
+            if (ret < 0) return ret;
+            inst.push_back(s);
+            iparm[0] = 1;
+            iparm[2] = method;
+            ret = s->Analyze(true, n, ap, ai, &ax[0], 1);
+            if (ret < 0) return ret;
+            if (0 == k)
+            {
+                method = (int)oparm[8];
+                first_us = oparm[0];
+            }
+            else other_us += oparm[0];
+        }
+        return 0;
+    }
+
+    /*
+    * AnalyzeTime: analysis time (in microsecond/us) of the first instance (with the ordering search), and of all other instances.
+    */
+    void AnalyzeTime(long long *first, long long *others) const
+    {
+        *first = first_us;
+        *others = other_us;
+    }
+
+    /*
+    * Solve: solves at all frequencies.
+    * @g: conductance values (length ap[n])
+    * @c: capacitance values (length ap[n])
+    * @nfreq: # of frequency points
+    * @omega: angular frequencies (length nfreq)
+    * @b: complex right-hand-side vector (length n, interleaved), the same at all frequencies
+    * @x: complex solutions (length n*nfreq, interleaved, frequency by frequency)
+    */
+    int Solve(const double g[], const double c[], int nfreq, const double omega[], const double b[], double x[])
+    {
+        const int k = (int)inst.size();
+        std::vector<int> rets(k, 0);
+        std::vector<std::thread> th;
+        for (int t = 0; t < k; ++t)
+        {
+            const int fb = (int)((long long)nfreq * t / k);
+            const int fe = (int)((long long)nfreq * (t + 1) / k);
+            th.push_back(std::thread([=, &rets]() { rets[t] = Batch(inst[t], g, c, fb, fe, omega, b, x); }));
+        }
+        for (int t = 0; t < k; ++t) th[t].join();
+        for (int t = 0; t < k; ++t)
+        {
+            if (rets[t] < 0) return rets[t];
+        }
+        return 0;
+    }
+
+private:
+    int Batch(ICktSo s, const double g[], const double c[], int fb, int fe, const double omega[], const double b[], double x[]) const
+    {
+        const int nnz = ap[n];
+        std::vector<double> ax((size_t)nnz * 2);
+        for (int f = fb; f < fe; ++f)
+        {
+            const double w = omega[f];
+            double *a = &ax[0];
+            for (int p = 0; p < nnz; ++p)
+            {
+                a[p + p] = g[p];
+                a[p + p + 1] = w * c[p];
+            }
+            int ret = s->Factorize(a, f > fb);
+            if (ret < 0) return ret;
+            ret = s->Solve(b, x + (size_t)f * n * 2, true, false);
+            if (ret < 0) return ret;
+        }
+        return 0;
+    }
+
+    int n;
+    const int *ap;
+    const int *ai;
+    std::vector<ICktSo> inst;
+    long long first_us;
+    long long other_us;
+};
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        printf("Usage: demo_acsweep <mtx file> <# of parallel frequency batches>\n");
+        printf("Example: demo_acsweep add20.mtx 4\n");
+        return -1;
+    }
+
+    int n;
+    int *ap = NULL;
+    int *ai = NULL;
+    double *g = NULL;
+    if (!ReadMtxFile(argv[1], n, ap, ai, g))
+    {
+        delete []ap;
+        delete []ai;
+        delete []g;
+        return -1;
+    }
+
+    //The matrix values are used as G, and C is generated randomly with the magnitude of G
+    const int nnz = ap[n];
+    const int nfreq = 100;
+    double *c = new double [nnz];
+    double *omega = new double [nfreq];
+    double *b = new double [n * 2];
+    double *x = new double [(size_t)n * 2 * nfreq];
+    double *cx = new double [nnz * 2];
+    if (NULL == c || NULL == omega || NULL == b || NULL == x || NULL == cx)
+    {
+        printf("Malloc failed.\n");
+        delete []ap;
+        delete []ai;
+        delete []g;
+        delete []c;
+        delete []omega;
+        delete []b;
+        delete []x;
+        delete []cx;
+        return -1;
+    }
+    for (int p = 0; p < nnz; ++p) c[p] = fabs(g[p]) * (double)rand() / RAND_MAX * 1e-9;
+    for (int f = 0; f < nfreq; ++f) omega[f] = 2. * 3.141592653589793 * pow(10., 3. + 9. * f / (nfreq - 1)); //1kHz~1THz
+    for (int i = 0; i < n; ++i)
+    {
+        b[i + i] = (double)rand() / RAND_MAX;
+        b[i + i + 1] = 0.;
+    }
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        const int batches = (0 == pass) ? 1 : atoi(argv[2]);
+        ACSweep sweep;
+        int ret = sweep.Initialize(n, ap, ai, g, c, batches);
+        if (ret < 0)
+        {
+            printf("Failed to initialize AC sweep, return code = %d.\n", ret);
+            break;
+        }
+        const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        ret = sweep.Solve(g, c, nfreq, omega, b, x);
+        const std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+        if (ret < 0)
+        {
+            printf("Failed to solve AC sweep, return code = %d.\n", ret);
+            break;
+        }
+        long long first, others;
+        sweep.AnalyzeTime(&first, &others);
+        printf("AC sweep of %d frequencies with %d batch(es): %lld us, analysis = %lld us (first instance) + %lld us (others).\n", nfreq,
+            batches, (long long)std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count(), first, others);
+    }
+
+    //Check the residuals at a few frequencies
+    ParallelMatVec<int> mv;
+    mv.Initialize(n, ap, ai, false, 1);
+    for (int f = 0; f < nfreq; f += nfreq / 4)
+    {
+        for (int p = 0; p < nnz; ++p)
+        {
+            cx[p + p] = g[p];
+            cx[p + p + 1] = omega[f] * c[p];
+        }
+        double berr;
+        const double res = mv.Residual(cx, x + (size_t)f * n * 2, b, NULL, true, &berr);
+        printf("Frequency %g Hz: residual = %g, backward error = %g.\n", omega[f] / (2. * 3.141592653589793), res, berr);
+    }
+
+    delete []ap;
+    delete []ai;
+    delete []g;
+    delete []c;
+    delete []omega;
+    delete []b;
+    delete []x;
+    delete []cx;
+    return 0;
+}
@@ -0,0 +1,119 @@
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS		1
+#define _CRT_NONSTDC_NO_WARNINGS	1
+#define _CRT_SECURE_NO_DEPRECATE	1
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "cktso.h"
+#include "mtxio.h"
+#include "peakmem.h"
+#ifdef _MSC_VER
+#pragma comment(lib, "cktso_l.lib")
+#endif
+
+/*
+* GridMatrix: k*k 5-point grid with a slightly unsymmetric stencil, for memory tests without a matrix file.
+*/
+void GridMatrix(long long k, long long &n, std::vector<long long> &ap, std::vector<long long> &ai, std::vector<double> &ax)
+{
+    n = k * k;
+    ap.assign(n + 1, 0);
+    ai.clear();
+    ax.clear();
+    ai.reserve(n * 5);
+    ax.reserve(n * 5);
+    for (long long r = 0; r < n; ++r)
+    {
+        const long long i = r / k, j = r % k;
+        if (i > 0) { ai.push_back(r - k); ax.push_back(-1.); }
+        if (j > 0) { ai.push_back(r - 1); ax.push_back(-1.1); }
+        ai.push_back(r);
+        ax.push_back(4.5);
+        if (j < k - 1) { ai.push_back(r + 1); ax.push_back(-0.9); }
+        if (i < k - 1) { ai.push_back(r + k); ax.push_back(-1.); }
+        ap[r + 1] = (long long)ai.size();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: demo_analyzemem <mtx or bin file> [# of threads] [ordering method]\n");
+        printf("       demo_analyzemem -g <grid size k> [# of threads] [ordering method]\n");
+        printf("Reports the process peak memory of one analysis next to the solver memory. The ordering method is iparm[2] (default 0,\n");
+        printf("all methods); run once per method to compare them, every run is a fresh process.\n");
+        printf("Example: demo_analyzemem -g 500 1 7\n");
+        return -1;
+    }
+
+    long long n;
+    std::vector<long long> ap, ai;
+    std::vector<double> ax;
+    int arg = 2;
+    if (0 == strcmp(argv[1], "-g"))
+    {
+        if (argc < 3 || atoll(argv[2]) <= 1)
+        {
+            printf("Invalid grid size.\n");
+            return -2;
+        }
+        GridMatrix(atoll(argv[2]), n, ap, ai, ax);
+        arg = 3;
+    }
+    else
+    {
+        bool is_complex;
+        const int ret = LoadMatrix(argv[1], n, ap, ai, ax, is_complex, 0);
+        if (ret < 0)
+        {
+            printf("Cannot load matrix file \"%s\", return code = %d.\n", argv[1], ret);
+            return ret;
+        }
+        if (is_complex)
+        {
+            printf("Matrix \"%s\" is complex.\n", argv[1]);
+            return -2;
+        }
+    }
+    const int threads = argc > arg ? atoi(argv[arg]) : 0;
+    const int method = argc > arg + 1 ? atoi(argv[arg + 1]) : 0;
+    printf("N = %lld, NNZ = %lld.\n", n, ap[n]);
+
+    ICktSo_L instance = NULL;
+    int *iparm;
+    const long long *oparm;
+    int ret = CKTSO_L_CreateSolver(&instance, &iparm, &oparm);
+    if (ret < 0)
+    {
+        printf("Failed to create solver instance, return code = %d.\n", ret);
+        return ret;
+    }
+    iparm[0] = 1;
+    iparm[2] = method;
+
+    //The ordering workspace is released at the end of analysis, so the process peak during analysis is reported separately from
+    //oparm[13]. The matrix is loaded before the peak is reset, and nothing else ran in this process, so freed heap from an earlier
+    //phase cannot hide part of the analysis workspace
+    const bool exact = ResetPeakMemory();
+    const long long base = CurrentMemory();
+    ret = instance->Analyze(false, n, ap.data(), ai.data(), ax.data(), threads);
+    const long long peak = PeakMemory();
+    if (ret < 0)
+    {
+        printf("Failed to analyze matrix, return code = %d.\n", ret);
+        instance->DestroySolver();
+        return ret;
+    }
+    printf("Analysis (iparm[2] = %d): time = %lld us, selected method = %lld, predicted flops = %lld.\n", method, oparm[0], oparm[8], oparm[17]);
+    printf("Analysis peak memory = %lld bytes%s, solver memory = %lld bytes (max %lld bytes).\n", (peak >= 0 && base >= 0) ? peak - base : -1,
+        exact ? "" : " (since process start)", oparm[12], oparm[13]);
+
+    ret = instance->Factorize(ax.data(), false);
+    printf("Factorization %s, NNZ(L) = %lld, NNZ(U) = %lld, solver max memory = %lld bytes.\n", ret >= 0 ? "done" : "failed", oparm[5], oparm[6], oparm[13]);
+    instance->DestroySolver();
+    return 0;
+}
@@ -0,0 +1,401 @@
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS		1
+#define _CRT_NONSTDC_NO_WARNINGS	1
+#define _CRT_SECURE_NO_DEPRECATE	1
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <thread>
+#include "cktso.h"
+#include "mtxio.h"
+#ifdef _MSC_VER
+#pragma comment(lib, "cktso.lib")
+#endif
+
+/*
+* AutoTuner: tunes the parameters that drive supernode creation and threading for Refactorize on a given matrix, and exports
+* them as a profile so later runs of the same design family start tuned.
+* Tuned: iparm[3] (dense node threshold), iparm[5] (max supernode size), iparm[6] (minimum # of columns for supernode detection),
+* iparm[11] (initial # of rows for supernode creation), and the thread number.
+* The search is a coordinate descent from the current settings: one parameter at a time is swept over a few candidates while the
+* others stay at their best values so far, and each candidate is measured by one factorization and the min time of a few
+* refactorizations. Supernodes are created by Factorize, so iparm[5], iparm[6] and iparm[11] are swept on the same analysis, in two
+* rounds since they interact. iparm[3] (ordering) and the thread number need a re-analysis per candidate; they are swept once, and
+* the search runs at most MAX_ANALYZE analyses in total (including the first one and going back to the best configuration), so on
+* a large matrix the tuning cost is bounded by about MAX_ANALYZE analysis times plus the factorizations.
+*/
+class AutoTuner
+{
+public:
+    enum
+    {
+        NPARAM = 5,
+        MAX_ANALYZE = 10,
+        VERSION = 1 //profile format version
+    };
+
+    AutoTuner() : threads(0), best_us(-1), analyses(0), an_dense(0), an_threads(0)
+    {
+        const int def[NPARAM - 1] = { 1000, -1, 64, 16 };
+        for (int k = 0; k < NPARAM - 1; ++k) value[k] = def[k];
+        threads = (int)std::thread::hardware_concurrency();
+        if (threads <= 0) threads = 1;
+    }
+
+    /*
+    * Tune: searches the parameter space with the values of the first refactorizations, then leaves inst analyzed and
+    * factorized with the best configuration applied.
+    * @reps: # of timed refactorizations per candidate
+    * @return: <0 for error
+    */
+    int Tune(ICktSo inst, int *iparm, const long long *oparm, int n, const int ap[], const int ai[], const double ax[], int reps)
+    {
+        const int timer = iparm[0];
+        iparm[0] = 1;
+        int cand[NPARAM][6];
+        int ncand[NPARAM] = { 0 };
+        const int dense[] = { 250, 500, 1000, 2000, 4000 };
+        const int maxsn[] = { -1, 32, 128, 512 };
+        const int mincol[] = { 8, 16, 32, 64, 128 };
+        const int initrow[] = { 4, 8, 16, 32, 64 };
+        Fill(cand[0], ncand[0], dense, sizeof(dense) / sizeof(int));
+        Fill(cand[1], ncand[1], maxsn, sizeof(maxsn) / sizeof(int));
+        Fill(cand[2], ncand[2], mincol, sizeof(mincol) / sizeof(int));
+        Fill(cand[3], ncand[3], initrow, sizeof(initrow) / sizeof(int));
+        const int hw = (int)std::thread::hardware_concurrency();
+        for (int t = 1; t < (hw > 0 ? hw : 1) && ncand[4] < 5; t += t) cand[4][ncand[4]++] = t;
+        if (hw > 1) cand[4][ncand[4]++] = hw;
+        else if (0 == ncand[4]) cand[4][ncand[4]++] = 1;
+
+        analyses = 0;
+        an_threads = 0; //force the first analysis
+        int ret = Measure(inst, iparm, oparm, n, ap, ai, ax, reps, &best_us);
+        if (ret < 0)
+        {
+            iparm[0] = timer;
+            return ret;
+        }
+        for (int round = 0; round < 2; ++round)
+        {
+            for (int k = 0; k < NPARAM; ++k)
+            {
+                const bool reanalyze = NeedAnalyze(k);
+                if (reanalyze && round > 0) continue;
+                const int keep = Get(k);
+                int bestv = keep;
+                for (int c = 0; c < ncand[k]; ++c)
+                {
+                    if (cand[k][c] == keep) continue;
+                    if (reanalyze && analyses + 2 > MAX_ANALYZE) break; //one for the candidate, one to go back
+                    Set(k, cand[k][c]);
+                    long long us;
+                    if (Measure(inst, iparm, oparm, n, ap, ai, ax, reps, &us) >= 0 && us * 100 < best_us * 97) //ignore timing noise
+                    {
+                        best_us = us;
+                        bestv = cand[k][c];
+                    }
+                }
+                Set(k, bestv);
+            }
+        }
+
+        //Leave the instance with the best configuration
+        ret = Prepare(inst, iparm, n, ap, ai, ax);
+        iparm[0] = timer;
+        return ret;
+    }
+
+    /*
+    * Apply: writes the tuned parameters into iparm, call before Analyze and pass Threads() as the thread number.
+    */
+    void Apply(int *iparm) const
+    {
+        iparm[3] = value[0];
+        iparm[5] = value[1];
+        iparm[6] = value[2];
+        iparm[11] = value[3];
+        iparm[9] = 0; //keep the tuned thread number
+    }
+
+    int Threads() const
+    {
+        return threads;
+    }
+
+    /*
+    * BestTime: min refactorization time (us) of the tuned configuration, -1 if not tuned.
+    */
+    long long BestTime() const
+    {
+        return best_us;
+    }
+
+    /*
+    * Analyses: # of analyses run by the last Tune (at most MAX_ANALYZE).
+    */
+    int Analyses() const
+    {
+        return analyses;
+    }
+
+    /*
+    * Save: exports the profile as a version line followed by text lines "name = value".
+    */
+    bool Save(const char file[]) const
+    {
+        FILE *fp = fopen(file, "w");
+        if (NULL == fp) return false;
+        fprintf(fp, "%% CKTSO tuned profile v%d\n", (int)VERSION);
+        for (int k = 0; k < NPARAM; ++k) fprintf(fp, "%s = %d\n", Name(k), Get(k));
+        fprintf(fp, "refactor_us = %lld\n", best_us);
+        fclose(fp);
+        return true;
+    }
+
+    /*
+    * Load: imports a profile written by Save. The first line must be the version line of this format, every other line is a comment
+    * ("%") or "name = value", all tuned parameters must be present and in range. Nothing is changed unless the whole file is valid.
+    * @return: -11 if the file cannot be opened, -2 if it is not a valid profile
+    */
+    int Load(const char file[])
+    {
+        FILE *fp = fopen(file, "r");
+        if (NULL == fp) return -11;
+        char buf[256];
+        int version = 0;
+        if (NULL == fgets(buf, 256, fp) || sscanf(buf, "%% CKTSO tuned profile v%d", &version) != 1 || version != VERSION)
+        {
+            fclose(fp);
+            return -2;
+        }
+        long long v[NPARAM + 1];
+        bool seen[NPARAM + 1] = { false };
+        int ret = 0;
+        while (0 == ret && fgets(buf, 256, fp) != NULL)
+        {
+            char name[64];
+            long long x;
+            const char *p = buf;
+            while (' ' == *p || '\t' == *p || '\r' == *p || '\n' == *p) ++p;
+            if ('\0' == *p || '%' == *p) continue;
+            if (sscanf(p, "%63s = %lld", name, &x) != 2)
+            {
+                ret = -2;
+                break;
+            }
+            int k = 0;
+            while (k < NPARAM && 0 != strcmp(name, Name(k))) ++k;
+            if (k == NPARAM && 0 != strcmp(name, "refactor_us")) ret = -2;
+            else if (seen[k] || !InRange(k, x)) ret = -2;
+            else
+            {
+                seen[k] = true;
+                v[k] = x;
+            }
+        }
+        fclose(fp);
+        for (int k = 0; k < NPARAM; ++k)
+        {
+            if (!seen[k]) ret = -2;
+        }
+        if (ret < 0) return ret;
+        for (int k = 0; k < NPARAM; ++k) Set(k, (int)v[k]);
+        best_us = seen[NPARAM] ? v[NPARAM] : -1;
+        return 0;
+    }
+
+private:
+    static void Fill(int dst[], int &cnt, const int src[], int len)
+    {
+        for (int i = 0; i < len; ++i) dst[i] = src[i];
+        cnt = len;
+    }
+
+    static const char *Name(int k)
+    {
+        static const char *const names[NPARAM] = { "iparm[3]", "iparm[5]", "iparm[6]", "iparm[11]", "threads" };
+        return names[k];
+    }
+
+    /*
+    * InRange: valid values of parameter k (NPARAM for refactor_us).
+    */
+    static bool InRange(int k, long long v)
+    {
+        switch (k)
+        {
+        case 0: return v > 0 && v <= 100000; //percentage
+        case 1: return -1 == v || (v > 0 && v <= INT_MAX);
+        case 2:
+        case 3: return v > 0 && v <= INT_MAX;
+        case 4: return v > 0 && v <= 4096;
+        default: return v >= -1;
+        }
+    }
+
+    /*
+    * NeedAnalyze: whether parameter k only takes effect in Analyze.
+    */
+    static bool NeedAnalyze(int k)
+    {
+        return 0 == k || NPARAM - 1 == k;
+    }
+
+    int Get(int k) const
+    {
+        return (k < NPARAM - 1) ? value[k] : threads;
+    }
+
+    void Set(int k, int v)
+    {
+        if (k < NPARAM - 1) value[k] = v;
+        else threads = v;
+    }
+
+    /*
+    * Prepare: applies the current configuration and factorizes, analyzing again only if iparm[3] or the thread number changed.
+    */
+    int Prepare(ICktSo inst, int *iparm, int n, const int ap[], const int ai[], const double ax[])
+    {
+        Apply(iparm);
+        if (value[0] != an_dense || threads != an_threads)
+        {
+            ++analyses;
+            an_dense = value[0];
+            an_threads = threads;
+            const int ret = inst->Analyze(false, n, ap, ai, ax, threads);
+            if (ret < 0)
+            {
+                an_threads = 0;
+                return ret;
+            }
+        }
+        return inst->Factorize(ax, false);
+    }
+
+    int Measure(ICktSo inst, int *iparm, const long long *oparm, int n, const int ap[], const int ai[], const double ax[], int reps, long long *us)
+    {
+        int ret = Prepare(inst, iparm, n, ap, ai, ax);
+        if (ret < 0) return ret;
+        long long min = LLONG_MAX;
+        for (int r = 0; r < reps; ++r)
+        {
+            ret = inst->Refactorize(ax);
+            if (ret < 0) return ret;
+            if (oparm[1] < min) min = oparm[1];
+        }
+        *us = min;
+        return 0;
+    }
+
+    int value[NPARAM - 1]; //iparm[3], iparm[5], iparm[6], iparm[11]
+    int threads;
+    long long best_us;
+    int analyses; //# of analyses in the last Tune
+    int an_dense; //iparm[3] and thread number of the last analysis
+    int an_threads;
+};
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        printf("Usage: demo_autotune <mtx file> <profile file>\n");
+        printf("Tunes and writes the profile if it does not exist, otherwise loads it and starts tuned.\n");
+        printf("Example: demo_autotune add20.mtx add20.profile\n");
+        return -1;
+    }
+
+    int n;
+    int *ap = NULL;
+    int *ai = NULL;
+    double *ax = NULL;
+    if (!ReadMtxFile(argv[1], n, ap, ai, ax))
+    {
+        delete []ap;
+        delete []ai;
+        delete []ax;
+        return -1;
+    }
+
+    ICktSo instance = NULL;
+    int *iparm;
+    const long long *oparm;
+    int ret = CKTSO_CreateSolver(&instance, &iparm, &oparm);
+    if (ret < 0)
+    {
+        printf("Failed to create solver instance, return code = %d.\n", ret);
+        delete []ap;
+        delete []ai;
+        delete []ax;
+        return ret;
+    }
+    iparm[0] = 1;
+
+    //Default configuration for reference
+    ret = instance->Analyze(false, n, ap, ai, ax, 0);
+    if (ret >= 0) ret = instance->Factorize(ax, false);
+    long long def = LLONG_MAX;
+    for (int r = 0; r < 20 && ret >= 0; ++r)
+    {
+        ret = instance->Refactorize(ax);
+        if (oparm[1] < def) def = oparm[1];
+    }
+    if (ret < 0)
+    {
+        printf("Failed to analyze or factorize matrix, return code = %d.\n", ret);
+        delete []ap;
+        delete []ai;
+        delete []ax;
+        instance->DestroySolver();
+        return ret;
+    }
+    printf("Default configuration: refactorization min time = %lld us.\n", def);
+
+    AutoTuner tuner;
+    ret = tuner.Load(argv[2]);
+    if (ret >= 0)
+    {
+        printf("Loaded profile \"%s\".\n", argv[2]);
+        tuner.Apply(iparm);
+        ret = instance->Analyze(false, n, ap, ai, ax, tuner.Threads());
+        if (ret >= 0) ret = instance->Factorize(ax, false);
+    }
+    else
+    {
+        if (-2 == ret) printf("Profile \"%s\" is not a valid v%d profile, tuning again.\n", argv[2], (int)AutoTuner::VERSION);
+        ret = tuner.Tune(instance, iparm, oparm, n, ap, ai, ax, 10);
+        if (ret >= 0)
+        {
+            printf("Tuning ran %d analyses (at most %d).\n", tuner.Analyses(), (int)AutoTuner::MAX_ANALYZE);
+            if (tuner.Save(argv[2])) printf("Tuned profile written to \"%s\".\n", argv[2]);
+            else printf("Cannot write profile \"%s\".\n", argv[2]);
+        }
+    }
+    if (ret < 0)
+    {
+        printf("Failed to tune, return code = %d.\n", ret);
+        delete []ap;
+        delete []ai;
+        delete []ax;
+        instance->DestroySolver();
+        return ret;
+    }
+    printf("iparm[3] = %d, iparm[5] = %d, iparm[6] = %d, iparm[11] = %d, threads = %d.\n", iparm[3], iparm[5], iparm[6], iparm[11], tuner.Threads());
+
+    long long min = LLONG_MAX;
+    for (int r = 0; r < 20 && ret >= 0; ++r)
+    {
+        ret = instance->Refactorize(ax);
+        if (oparm[1] < min) min = oparm[1];
+    }
+    printf("Tuned configuration: refactorization min time = %lld us.\n", min);
+
+    delete []ap;
+    delete []ai;
+    delete []ax;
+    instance->DestroySolver();
+    return 0;
+}
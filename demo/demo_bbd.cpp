@@ -0,0 +1,327 @@
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS		1
+#define _CRT_NONSTDC_NO_WARNINGS	1
+#define _CRT_SECURE_NO_DEPRECATE	1
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include "cktso.h"
+#include "bbd.h"
+#include "matvec.h"
+#ifdef _MSC_VER
+#pragma comment(lib, "cktso.lib")
+#endif
+
+/*
+* BBDSolver: bordered-block-diagonal solver driven by a circuit partition (row mode, real).
+* Each node belongs to one partition or to the border (see bbd.h for the block structure). Every diagonal block is factorized by its
+* own solver instance with full pivoting inside the block, and the border Schur complement is assembled as a sparse matrix and
+* factorized by another instance with full pivoting. A partition does not make the blocks nonsingular, so nodes that leave a block
+* structurally singular are moved to the border at analysis (Isolate), and when a block fails with -6 in Factorize the node of its
+* singular row is moved to the border and the split is analyzed again (FactorizeRepaired). The blocks are processed in parallel on a
+* persistent worker pool.
+*/
+class BBDSolver
+{
+public:
+    BBDSolver() : n(0), nb(0), ap(NULL), ai(NULL), threads(1), moved(0), schur(NULL), axv(NULL)
+    {
+    }
+
+    ~BBDSolver()
+    {
+        for (size_t k = 0; k < blk.size(); ++k)
+        {
+            if (NULL != blk[k].inst) blk[k].inst->DestroySolver();
+        }
+        if (NULL != schur) schur->DestroySolver();
+    }
+
+    /*
+    * Analyze: builds the block structure and analyzes all blocks and the Schur complement.
+    * @ap, @ai: kept by the solver and used again when Factorize moves nodes to the border, so they must stay valid
+    * @part: partition of each node (0~nparts-1), or -1 for a border node. An entry coupling two different partitions moves its
+    *        column node to the border, and so does a node that leaves its block structurally singular
+    * @threads: # of threads, blocks are distributed among threads and each block is factorized sequentially
+    */
+    int Analyze(int n_, const int ap_[], const int ai_[], const double ax[], const int part_[], int nparts, int threads_)
+    {
+        n = n_;
+        ap = ap_;
+        ai = ai_;
+        axv = NULL;
+        threads = (threads_ > 0) ? threads_ : (int)std::thread::hardware_concurrency();
+        if (threads <= 0) threads = 1;
+        part.assign(part_, part_ + n);
+        for (int i = 0; i < n; ++i)
+        {
+            if (part[i] < -1 || part[i] >= nparts) return -2;
+        }
+        for (int i = 0; i < n; ++i)
+        {
+            for (int p = ap[i]; p < ap[i + 1]; ++p)
+            {
+                const int j = ai[p];
+                if (part[i] >= 0 && part[j] >= 0 && part[i] != part[j]) part[j] = -1;
+            }
+        }
+        moved = Isolate(n, ap, ai, &part[0]);
+
+        //Create instances, kept when Factorize changes the split
+        for (size_t k = 0; k < blk.size(); ++k)
+        {
+            if (NULL != blk[k].inst) blk[k].inst->DestroySolver();
+        }
+        blk.assign(nparts, BBDBlock<int>());
+        int ret = 0;
+        for (int k = 0; k < nparts && ret >= 0; ++k) ret = blk[k].Create();
+        if (ret >= 0 && NULL == schur)
+        {
+            int *iparm;
+            const long long *oparm;
+            ret = CKTSO_CreateSolver(&schur, &iparm, &oparm);
+        }
+        if (ret < 0) return ret;
+        const int workers = std::max(1, std::min(threads, nparts));
+        if (pool.Threads() != workers) pool.Start(workers);
+        return Setup(ax);
+    }
+
+    /*
+    * Factorize: factorizes all blocks with pivoting and then the Schur complement. Singular blocks are repaired by moving their
+    * singular nodes to the border and analyzing again (see the class comment).
+    */
+    int Factorize(const double ax[])
+    {
+        return FactorizeRepaired(&part[0], moved, [&](std::vector<int> &bad) { return Numeric(ax, false, &bad); }, [&]() { return Setup(ax); });
+    }
+
+    /*
+    * Refactorize: refactorizes all blocks and the Schur complement without pivoting.
+    */
+    int Refactorize(const double ax[])
+    {
+        return Numeric(ax, true, NULL);
+    }
+
+    /*
+    * Solve: solves Ax=b after the matrix is factorized.
+    * @return: -9 if Factorize/Refactorize has not succeeded
+    */
+    int Solve(const double b[], double x[])
+    {
+        if (NULL == axv) return -9;
+        const int nparts = (int)blk.size();
+        std::vector<int> rets(nparts, 0);
+        ParallelFor(pool, nparts, [&](int k)
+        {
+            rets[k] = blk[k].Condense(b, true);
+        });
+        for (int k = 0; k < nparts; ++k)
+        {
+            if (rets[k] < 0) return rets[k];
+        }
+
+        if (nb > 0)
+        {
+            for (int r = 0; r < nb; ++r) xb[r] = b[border[r]];
+            for (int k = 0; k < nparts; ++k)
+            {
+                const BBDBlock<int> &bk = blk[k];
+                for (size_t r = 0; r < bk.brows.size(); ++r) xb[bk.brows[r]] -= bk.g[r];
+            }
+            const int ret = schur->Solve(&xb[0], &xb[0], false, false);
+            if (ret < 0) return ret;
+            for (int r = 0; r < nb; ++r) x[border[r]] = xb[r];
+        }
+
+        ParallelFor(pool, nparts, [&](int k)
+        {
+            blk[k].BackSubstitute(nb > 0 ? &xb[0] : NULL, x);
+        });
+        return 0;
+    }
+
+    int BorderSize() const
+    {
+        return nb;
+    }
+
+    int SchurNnz() const
+    {
+        return (int)s.si.size();
+    }
+
+    /*
+    * Moved: # of nodes moved from the partitions to the border because their blocks were singular.
+    */
+    int Moved() const
+    {
+        return moved;
+    }
+
+private:
+    /*
+    * Setup: splits the blocks and S from part and analyzes them.
+    */
+    int Setup(const double ax[])
+    {
+        axv = NULL;
+        const int nparts = (int)blk.size();
+
+        //Local indexes
+        std::vector<int> count(nparts, 0);
+        local.assign(n, 0);
+        nb = 0;
+        for (int i = 0; i < n; ++i) local[i] = (part[i] < 0) ? nb++ : count[part[i]]++;
+        border.assign(nb, 0);
+        for (int i = 0; i < n; ++i)
+        {
+            if (part[i] < 0) border[local[i]] = i;
+        }
+
+        //Split entries into Akk, Akb, Abk and Abb, then the pattern of S
+        for (int k = 0; k < nparts; ++k) blk[k].Split(ap, ai, part, k, local, border);
+        s.Build(ap, ai, part, local, border, &blk[0], nparts);
+        xb.resize(nb);
+
+        //Analyze blocks, then S without values
+        std::vector<int> rets(nparts, 0);
+        ParallelFor(pool, nparts, [&](int k)
+        {
+            rets[k] = blk[k].Analyze(ax, 1);
+        });
+        for (int k = 0; k < nparts; ++k)
+        {
+            if (rets[k] < 0) return rets[k];
+        }
+        if (nb > 0) return schur->Analyze(false, nb, &s.sp[0], &s.si[0], NULL, threads);
+        return 0;
+    }
+
+    /*
+    * Numeric: factorizes or refactorizes the blocks and S.
+    * @bad: if not NULL, gets the nodes of the singular rows of the blocks whose factorization returned -6
+    */
+    int Numeric(const double ax[], bool refactor, std::vector<int> *bad)
+    {
+        axv = NULL;
+        const int nparts = (int)blk.size();
+        std::vector<int> rets(nparts, 0);
+        ParallelFor(pool, nparts, [&](int k)
+        {
+            rets[k] = blk[k].Eliminate(ax, refactor);
+        });
+        int ret = 0;
+        for (int k = 0; k < nparts; ++k)
+        {
+            if (rets[k] < 0 && ret >= 0) ret = rets[k];
+            if (-6 == rets[k] && NULL != bad && blk[k].SingularNode() >= 0) bad->push_back(blk[k].SingularNode());
+        }
+        if (ret < 0) return ret;
+        if (nb > 0)
+        {
+            s.Assemble(ax, &blk[0], nparts);
+            ret = refactor ? schur->Refactorize(&s.sx[0]) : schur->Factorize(&s.sx[0], false);
+            if (ret < 0) return ret;
+        }
+        axv = ax;
+        return 0;
+    }
+
+    int n;
+    int nb; //# of border nodes
+    const int *ap; //pattern given to Analyze
+    const int *ai;
+    int threads;
+    int moved; //# of nodes moved to the border for singular blocks
+    std::vector<int> part;
+    std::vector<int> local; //local index of each node in its block or in the border
+    std::vector<int> border; //global node of each border node
+    std::vector<BBDBlock<int> > blk;
+    BBDSchur<int> s;
+    std::vector<double> xb;
+    ICktSo schur;
+    WorkerPool pool; //threads running the blocks
+    const double *axv; //values of the last factorized matrix, NULL before the first successful factorization
+};
+
+int main(int argc, char *argv[])
+{
+    const int threads = (argc > 1) ? atoi(argv[1]) : 0;
+    int n;
+    std::vector<int> ap, ai, part;
+    std::vector<double> ax;
+    BuildCircuit(8, 60, 40, 4, n, ap, ai, ax, part);
+    std::vector<double> b(n), x(n, 0.);
+    for (int i = 0; i < n; ++i) b[i] = (double)rand() / RAND_MAX;
+    printf("Matrix: n = %d, nnz = %d.\n", n, ap[n]);
+
+    BBDSolver bbd;
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    int ret = bbd.Analyze(n, &ap[0], &ai[0], &ax[0], &part[0], 8, threads);
+    if (ret < 0)
+    {
+        printf("Failed to analyze BBD matrix, return code = %d.\n", ret);
+        return ret;
+    }
+    std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+    printf("BBD analysis time = %lld us, border size = %d, nnz(S) = %d, moved to the border = %d.\n",
+        (long long)std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count(), bbd.BorderSize(), bbd.SchurNnz(), bbd.Moved());
+
+    ParallelMatVec<int> mv;
+    mv.Initialize(n, &ap[0], &ai[0], false, threads);
+    for (int j = 0; j < 5; ++j)
+    {
+        //Change values slightly, as in Newton-Raphson iterations
+        if (j > 0)
+        {
+            for (size_t p = 0; p < ax.size(); ++p) ax[p] *= 1. + ((double)rand() / RAND_MAX - .5) * .1;
+        }
+        t0 = std::chrono::steady_clock::now();
+        ret = (0 == j) ? bbd.Factorize(&ax[0]) : bbd.Refactorize(&ax[0]);
+        t1 = std::chrono::steady_clock::now();
+        if (ret >= 0) ret = bbd.Solve(&b[0], &x[0]);
+        std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+        if (ret < 0)
+        {
+            printf("Failed to factorize or solve, return code = %d.\n", ret);
+            return ret;
+        }
+        double berr;
+        const double res = mv.Residual(&ax[0], &x[0], &b[0], NULL, false, &berr);
+        printf("%s [%d] time = %lld us, solve time = %lld us, residual = %g, backward error = %g.\n", 0 == j ? "Factorization" : "Refactorization", j,
+            (long long)std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count(),
+            (long long)std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count(), res, berr);
+        if (0 == j) printf("Border size after factorization = %d, moved to the border = %d.\n", bbd.BorderSize(), bbd.Moved());
+    }
+
+    //For comparison, factorize the whole matrix with a single instance
+    ICktSo instance = NULL;
+    int *iparm;
+    const long long *oparm;
+    ret = CKTSO_CreateSolver(&instance, &iparm, &oparm);
+    if (ret < 0)
+    {
+        printf("Failed to create solver instance, return code = %d.\n", ret);
+        return ret;
+    }
+    iparm[0] = 1;
+    ret = instance->Analyze(false, n, &ap[0], &ai[0], &ax[0], threads);
+    if (ret >= 0) ret = instance->Factorize(&ax[0], false);
+    if (ret >= 0)
+    {
+        printf("Whole matrix: analysis time = %lld us, factorization time = %lld us", oparm[0], oparm[1]);
+        instance->Refactorize(&ax[0]);
+        printf(", refactorization time = %lld us", oparm[1]);
+        instance->Solve(&b[0], &x[0], false, false);
+        printf(", solve time = %lld us.\n", oparm[2]);
+    }
+    instance->DestroySolver();
+    return 0;
+}
@@ -0,0 +1,244 @@
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS		1
+#define _CRT_NONSTDC_NO_WARNINGS	1
+#define _CRT_SECURE_NO_DEPRECATE	1
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "cktso.h"
+#include "mtxio.h"
+#ifdef _MSC_VER
+#pragma comment(lib, "cktso.lib")
+#endif
+
+/*
+* Norm1: 1-norm (maximum absolute column sum) of a row-mode (CSR) matrix.
+*/
+double Norm1(const int n, const int ap[], const int ai[], const double ax[], double work[])
+{
+    memset(work, 0, sizeof(double) * n);
+    for (int i = 0; i < n; ++i)
+    {
+        for (int p = ap[i]; p < ap[i + 1]; ++p) work[ai[p]] += fabs(ax[p]);
+    }
+    double s = 0.;
+    for (int i = 0; i < n; ++i)
+    {
+        if (work[i] > s) s = work[i];
+    }
+    return s;
+}
+
+/*
+* InverseNorm1: estimates ||A^(-1)||_1 by Hager's method with Higham's refinements (the LAPACK xLACON algorithm), using only
+* Solve in row mode (A^(-1)*v) and column mode (A^(-T)*v) (call this routine after matrix has been factorized or refactorized).
+* A few solves are needed, usually 4~5.
+* @work: buffer of length 3n
+* @return: estimated ||A^(-1)||_1, or <0 for error
+*/
+double InverseNorm1(ICktSo inst, const int n, double work[])
+{
+    double *x = work;
+    double *y = work + n;
+    double *sgn = work + n + n;
+    for (int i = 0; i < n; ++i)
+    {
+        x[i] = 1. / n;
+        sgn[i] = 0.; //no previous sign vector, never equal to a new one
+    }
+
+    double est = 0.;
+    int last = -1;
+    for (int iter = 0; iter < 5; ++iter)
+    {
+        if (inst->Solve(x, y, false, false) < 0) return -1.;
+        double s = 0.;
+        bool same = (iter > 0);
+        for (int i = 0; i < n; ++i)
+        {
+            s += fabs(y[i]);
+            const double g = (y[i] >= 0.) ? 1. : -1.;
+            if (g != sgn[i]) same = false;
+            sgn[i] = g;
+        }
+        if (iter > 0 && s <= est) break;
+        est = s;
+        if (same) break;
+
+        if (inst->Solve(sgn, x, false, true) < 0) return -1.;
+        int j = 0;
+        for (int i = 1; i < n; ++i)
+        {
+            if (fabs(x[i]) > fabs(x[j])) j = i;
+        }
+        if (j == last) break;
+        last = j;
+        memset(x, 0, sizeof(double) * n);
+        x[j] = 1.;
+    }
+
+    //Alternative estimate with an alternating-sign vector, which protects against the worst cases of Hager's method
+    for (int i = 0; i < n; ++i)
+    {
+        x[i] = ((i & 1) ? -1. : 1.) * (1. + (n > 1 ? (double)i / (n - 1) : 0.));
+    }
+    if (inst->Solve(x, y, false, false) < 0) return -1.;
+    double s = 0.;
+    for (int i = 0; i < n; ++i) s += fabs(y[i]);
+    s = s * 2. / (3. * n);
+    return (s > est) ? s : est;
+}
+
+/*
+* ReciprocalPivotGrowth: calculates min_i(max_j|M(i,j)|/max_j|L(i,j)|), where M=L*U is the permuted (and scaled) matrix.
+* CKTSO pivots along rows and U has a unit diagonal, so pivot growth shows up in the rows of L. A value much smaller than 1 means
+* the factors are unstable (call this routine after matrix has been factorized or refactorized).
+* @scaled: whether scaling is enabled (iparm[7] != 0)
+* @return: reciprocal pivot growth, or <0 for error
+*/
+double ReciprocalPivotGrowth(ICktSo inst, const long long oparm[], const int n, const int ap[], const int ai[], const double ax[], bool scaled)
+{
+    size_t *lp = new size_t [(n + 1) * 2];
+    size_t *up = lp + n + 1;
+    int *li = new int [oparm[5] + oparm[6] + n * 2];
+    int *ui = li + oparm[5];
+    int *rperm = ui + oparm[6];
+    int *cperm = rperm + n;
+    double *lx = new double [oparm[5] + n * 2];
+    double *rscale = lx + oparm[5];
+    double *cscale = rscale + n;
+    double rpg = -1.;
+    if (NULL != lp && NULL != li && NULL != lx
+        && inst->ExtractFactors(lp, li, lx, up, ui, NULL, rperm, cperm, rscale, cscale) >= 0)
+    {
+        rpg = 1.;
+        for (int i = 0; i < n; ++i)
+        {
+            const int r = rperm[i];
+            double amax = 0.;
+            for (int p = ap[r]; p < ap[r + 1]; ++p)
+            {
+                const double a = scaled ? fabs(rscale[r] * ax[p] * cscale[ai[p]]) : fabs(ax[p]);
+                if (a > amax) amax = a;
+            }
+            double lmax = 0.;
+            for (size_t p = lp[i]; p < lp[i + 1]; ++p)
+            {
+                if (fabs(lx[p]) > lmax) lmax = fabs(lx[p]);
+            }
+            if (lmax > 0. && amax < rpg * lmax) rpg = amax / lmax;
+        }
+    }
+    delete []lp;
+    delete []li;
+    delete []lx;
+    return rpg;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        printf("Usage: demo_condest <mtx file> <# of threads>\n");
+        printf("Example: demo_condest add20.mtx 4\n");
+        return -1;
+    }
+
+    int n;
+    int *ap = NULL;
+    int *ai = NULL;
+    double *ax = NULL;
+    if (!ReadMtxFile(argv[1], n, ap, ai, ax))
+    {
+        delete []ap;
+        delete []ai;
+        delete []ax;
+        return -1;
+    }
+    const int nnz = ap[n];
+    double *cx = new double [nnz]; //original values
+    double *work = new double [n * 3];
+    if (NULL == cx || NULL == work)
+    {
+        printf("Malloc for vectors failed.\n");
+        delete []ap;
+        delete []ai;
+        delete []ax;
+        delete []cx;
+        delete []work;
+        return -1;
+    }
+    memcpy(cx, ax, sizeof(double) * nnz);
+
+    ICktSo instance = NULL;
+    int *iparm;
+    const long long *oparm;
+    int ret = CKTSO_CreateSolver(&instance, &iparm, &oparm);
+    if (ret < 0)
+    {
+        printf("Failed to create solver instance, return code = %d.\n", ret);
+        delete []ap;
+        delete []ai;
+        delete []ax;
+        delete []cx;
+        delete []work;
+        return ret;
+    }
+
+    ret = instance->Analyze(false, n, ap, ai, ax, atoi(argv[2]));
+    if (ret >= 0) ret = instance->Factorize(ax, false);
+    if (ret < 0)
+    {
+        printf("Failed to analyze or factorize matrix, return code = %d.\n", ret);
+        delete []ap;
+        delete []ai;
+        delete []ax;
+        delete []cx;
+        delete []work;
+        instance->DestroySolver();
+        return ret;
+    }
+
+    //Simulate Newton-Raphson iterations with refactorization: the condition number estimate and the reciprocal pivot growth
+    //tell when the pivots chosen by the last factorization are no longer good enough and factorization with pivoting is needed
+    const double pivot_tol = iparm[1] * 1e-6;
+    for (int j = 0; j < 10; ++j)
+    {
+        const char *path = "factorization";
+        if (j > 0)
+        {
+            const double spread = (j < 5) ? 1.1 : 1e14;
+            for (int p = 0; p < nnz; ++p)
+            {
+                ax[p] = cx[p] * pow(spread, (double)rand() / RAND_MAX - .5);
+            }
+            ret = instance->Refactorize(ax);
+            path = "refactorization";
+        }
+
+        double rpg = (ret >= 0) ? ReciprocalPivotGrowth(instance, oparm, n, ap, ai, ax, iparm[7] != 0) : -1.;
+        if (ret < 0 || rpg < pivot_tol)
+        {
+            path = "refactorization rejected, factorization";
+            ret = instance->Factorize(ax, true);
+            if (ret >= 0) rpg = ReciprocalPivotGrowth(instance, oparm, n, ap, ai, ax, iparm[7] != 0);
+        }
+        if (ret < 0)
+        {
+            printf("Failed to factorize matrix, return code = %d.\n", ret);
+            break;
+        }
+        const double cond = Norm1(n, ap, ai, ax, work) * InverseNorm1(instance, n, work);
+        printf("Iteration [%d]: %s, condition number (1-norm) = %g, reciprocal pivot growth = %g.\n", j, path, cond, rpg);
+    }
+
+    delete []ap;
+    delete []ai;
+    delete []ax;
+    delete []cx;
+    delete []work;
+    instance->DestroySolver();
+    return 0;
+}
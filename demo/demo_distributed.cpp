@@ -0,0 +1,697 @@
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS		1
+#define _CRT_NONSTDC_NO_WARNINGS	1
+#define _CRT_SECURE_NO_DEPRECATE	1
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "cktso.h"
+#include "mtxio.h"
+#include "bbd.h"
+#ifdef _MSC_VER
+#pragma comment(lib, "cktso.lib")
+#endif
+
+/*
+* Transport: point-to-point message passing between ranks (processes), the subset of MPI used by DistributedSolver.
+* Send is buffered (returns once buf can be reused) and messages between the same (source, destination, tag) are delivered in order.
+* An MPI transport maps Send/Recv to MPI_Send/MPI_Recv on MPI_BYTE with the same rank and tag.
+*/
+class Transport
+{
+public:
+    virtual ~Transport()
+    {
+    }
+    virtual int Rank() const = 0;
+    virtual int Size() const = 0;
+    virtual int Send(int dest, int tag, const void *buf, size_t bytes) = 0;
+    virtual int Recv(int src, int tag, void *buf, size_t bytes) = 0;
+};
+
+/*
+* LoopbackHub: shared-memory mailboxes for LoopbackTransport, one hub per group of ranks running as threads of one process.
+*/
+class LoopbackHub
+{
+public:
+    explicit LoopbackHub(int size_) : size(size_)
+    {
+    }
+
+    int Size() const
+    {
+        return size;
+    }
+
+    void Put(int src, int dest, int tag, const void *buf, size_t bytes)
+    {
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            box[Key(src, dest, tag)].push_back(std::vector<char>((const char *)buf, (const char *)buf + bytes));
+        }
+        cv.notify_all();
+    }
+
+    int Get(int src, int dest, int tag, void *buf, size_t bytes)
+    {
+        std::unique_lock<std::mutex> lk(mtx);
+        std::deque<std::vector<char> > &q = box[Key(src, dest, tag)];
+        cv.wait(lk, [&q] { return !q.empty(); });
+        const int ret = (q.front().size() == bytes) ? 0 : -2;
+        if (0 == ret && bytes > 0) memcpy(buf, &q.front()[0], bytes);
+        q.pop_front();
+        return ret;
+    }
+
+private:
+    long long Key(int src, int dest, int tag) const
+    {
+        return ((long long)src * size + dest) * 256 + tag;
+    }
+
+    int size;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::map<long long, std::deque<std::vector<char> > > box;
+};
+
+class LoopbackTransport : public Transport
+{
+public:
+    LoopbackTransport(LoopbackHub *hub_, int rank_) : hub(hub_), rank(rank_)
+    {
+    }
+
+    virtual int Rank() const
+    {
+        return rank;
+    }
+
+    virtual int Size() const
+    {
+        return hub->Size();
+    }
+
+    virtual int Send(int dest, int tag, const void *buf, size_t bytes)
+    {
+        if (dest < 0 || dest >= hub->Size() || tag < 0 || tag >= 256) return -2;
+        hub->Put(rank, dest, tag, buf, bytes);
+        return 0;
+    }
+
+    virtual int Recv(int src, int tag, void *buf, size_t bytes)
+    {
+        if (src < 0 || src >= hub->Size() || tag < 0 || tag >= 256) return -2;
+        return hub->Get(src, rank, tag, buf, bytes);
+    }
+
+private:
+    LoopbackHub *hub;
+    int rank;
+};
+
+/*
+* Dissect: top levels of a nested dissection on the symmetrized pattern, producing one subdomain per rank.
+* Each level orders a node set breadth-first from a pseudo-peripheral node and splits the order near the share of each half; the
+* nodes on one side of the split adjacent to the other side form the vertex separator. A few split points around the share are
+* tried and the smallest separator is kept. Disconnected node sets are handled by restarting the search.
+* @part: gets the subdomain (0~nparts-1) of each node, or -1 for separator nodes
+*/
+void Dissect(long long n, const long long ap[], const long long ai[], int nparts, long long part[])
+{
+    //Symmetrized adjacency
+    std::vector<long long> gp(n + 1, 0), gi;
+    {
+        std::vector<std::vector<long long> > adj(n);
+        for (long long i = 0; i < n; ++i)
+        {
+            for (long long p = ap[i]; p < ap[i + 1]; ++p)
+            {
+                const long long j = ai[p];
+                if (j == i) continue;
+                adj[i].push_back(j);
+                adj[j].push_back(i);
+            }
+        }
+        for (long long i = 0; i < n; ++i)
+        {
+            std::sort(adj[i].begin(), adj[i].end());
+            adj[i].erase(std::unique(adj[i].begin(), adj[i].end()), adj[i].end());
+            gi.insert(gi.end(), adj[i].begin(), adj[i].end());
+            gp[i + 1] = (long long)gi.size();
+        }
+    }
+
+    std::vector<long long> set(n);
+    for (long long i = 0; i < n; ++i) set[i] = i;
+    std::vector<int> stamp(n, 0); //stamp of the node set a node belongs to
+    std::vector<int> seen(n, 0);
+    std::vector<long long> pos(n, 0); //breadth-first position
+    int nstamp = 0, nseen = 0;
+
+    //Work list of (node set, first subdomain, # of subdomains)
+    struct Job
+    {
+        std::vector<long long> nodes;
+        int first;
+        int count;
+    };
+    std::vector<Job> jobs(1);
+    jobs[0].nodes.swap(set);
+    jobs[0].first = 0;
+    jobs[0].count = nparts;
+    while (!jobs.empty())
+    {
+        Job job;
+        job.nodes.swap(jobs.back().nodes);
+        job.first = jobs.back().first;
+        job.count = jobs.back().count;
+        jobs.pop_back();
+        if (job.count <= 1 || job.nodes.size() < 2)
+        {
+            for (size_t e = 0; e < job.nodes.size(); ++e) part[job.nodes[e]] = job.first;
+            continue;
+        }
+
+        ++nstamp;
+        for (size_t e = 0; e < job.nodes.size(); ++e) stamp[job.nodes[e]] = nstamp;
+
+        //Breadth-first order, started twice to reach a pseudo-peripheral node
+        std::vector<long long> order;
+        long long start = job.nodes[0];
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            order.clear();
+            ++nseen;
+            size_t next = 0;
+            for (size_t e = 0; order.size() < job.nodes.size(); ++e)
+            {
+                const long long s = (0 == e) ? start : job.nodes[e - 1];
+                if (seen[s] == nseen) continue;
+                seen[s] = nseen;
+                order.push_back(s);
+                for (; next < order.size(); ++next)
+                {
+                    const long long i = order[next];
+                    for (long long p = gp[i]; p < gp[i + 1]; ++p)
+                    {
+                        const long long j = gi[p];
+                        if (stamp[j] != nstamp || seen[j] == nseen) continue;
+                        seen[j] = nseen;
+                        order.push_back(j);
+                    }
+                }
+                if (0 == pass) break;
+            }
+            start = order.back();
+        }
+
+        //Lowest and highest breadth-first positions among the neighbors of each node
+        const size_t m = order.size();
+        for (size_t e = 0; e < m; ++e) pos[order[e]] = (long long)e;
+        std::vector<long long> lo(m), hi(m);
+        for (size_t e = 0; e < m; ++e)
+        {
+            const long long i = order[e];
+            lo[e] = hi[e] = (long long)e;
+            for (long long p = gp[i]; p < gp[i + 1]; ++p)
+            {
+                if (stamp[gi[p]] != nstamp) continue;
+                lo[e] = std::min(lo[e], pos[gi[p]]);
+                hi[e] = std::max(hi[e], pos[gi[p]]);
+            }
+        }
+
+        //Split the order at k (near the share of the first half of the subdomains) and take as separator either the nodes after k
+        //adjacent to the first part or the nodes before k adjacent to the second part, minimizing the separator size divided by the
+        //balance (the smaller of the two parts relative to its share)
+        const int cl = job.count / 2;
+        const size_t target = m * cl / job.count;
+        size_t k = target;
+        double best = HUGE_VAL;
+        bool before = false;
+        for (int t = -8; t <= 8; ++t)
+        {
+            const long long kc = (long long)target + (long long)target * t / 20;
+            if (kc <= 0 || kc >= (long long)m) continue;
+            size_t sa = 0, sb = 0;
+            for (long long e = 0; e < (long long)m; ++e)
+            {
+                if (e < kc) sa += (hi[e] >= kc);
+                else sb += (lo[e] < kc);
+            }
+            for (int side = 0; side < 2; ++side)
+            {
+                const double na = (double)(kc - (long long)(side ? sa : 0));
+                const double nb = (double)((long long)m - kc - (long long)(side ? 0 : sb));
+                const double bal = std::min(na / target, nb / (m - target));
+                const double score = (side ? sa : sb) / std::max(bal, 1e-3);
+                if (score < best)
+                {
+                    best = score;
+                    k = (size_t)kc;
+                    before = (1 == side);
+                }
+            }
+        }
+        Job a, b;
+        a.first = job.first;
+        a.count = cl;
+        b.first = job.first + cl;
+        b.count = job.count - cl;
+        for (size_t e = 0; e < m; ++e)
+        {
+            const bool sep = (e < k) ? (before && hi[e] >= (long long)k) : (!before && lo[e] < (long long)k);
+            if (sep) part[order[e]] = -1;
+            else if (e < k) a.nodes.push_back(order[e]);
+            else b.nodes.push_back(order[e]);
+        }
+        for (size_t e = 0; e < b.nodes.size(); ++e) stamp[b.nodes[e]] = 0;
+        jobs.push_back(Job());
+        jobs.back().nodes.swap(a.nodes);
+        jobs.back().first = a.first;
+        jobs.back().count = a.count;
+        jobs.push_back(Job());
+        jobs.back().nodes.swap(b.nodes);
+        jobs.back().first = b.first;
+        jobs.back().count = b.count;
+    }
+}
+
+/*
+* DistributedSolver: distributed-memory solver over a Transport (row mode, real, 64-bit indexes), to be run by every rank (SPMD).
+* The top levels of a nested dissection give one subdomain per rank; the separators of all levels form the border. After permutation
+*     | A11          A1b |
+*     |      ...     ... |
+*     |          Akk Akb |
+*     | Ab1 ...  Abk Abb |
+* Rank k factorizes its block Akk with its own ICktSo_L instance (full pivoting inside the block) and sends its contribution
+* Abk*Akk^(-1)*Akb to rank 0, which assembles the border Schur complement S = Abb - sum(Abk*Akk^(-1)*Akb) and factorizes it with
+* another instance (full pivoting over the border). The block split, the elimination of a block and the assembly of S are the
+* BBDBlock and BBDSchur of bbd.h with long long indexes. Pivots are not exchanged across subdomains, so every block must be
+* nonsingular, which a dissection of the pattern does not guarantee (it knows nothing about voltage sources or controlled sources).
+* Nodes that make a block structurally singular are moved to the border before analysis (Isolate of bbd.h). When the factorization
+* of a block fails with -6, the node of the singular row (oparm[9]) is moved to the border, the blocks and S are rebuilt and analyzed
+* again, and the factorization is retried, at most BBD_MAX_ROUNDS times (FactorizeRepaired of bbd.h). The border is factorized with
+* full pivoting, so a nonsingular matrix is solved once its blocks are.
+* The matrix and right-hand-side are given in full on every rank (centralized input); the solution is gathered on rank 0.
+*/
+class DistributedSolver
+{
+public:
+    explicit DistributedSolver(Transport *tr_) : tr(tr_), n(0), nb(0), ap(NULL), ai(NULL), threads(1), moved(0), schur(NULL)
+    {
+    }
+
+    ~DistributedSolver()
+    {
+        if (!blk.empty() && NULL != blk[tr->Rank()].inst) blk[tr->Rank()].inst->DestroySolver();
+        if (NULL != schur) schur->DestroySolver();
+    }
+
+    /*
+    * Analyze: partitions the matrix (identically on every rank), analyzes the local block, and on rank 0 the Schur complement.
+    * @ap, @ai: kept by the solver and used again when Factorize moves nodes to the border, so they must stay valid
+    * @threads: # of threads used by the local block
+    * @return: the same on all ranks, <0 if any rank failed
+    */
+    int Analyze(long long n_, const long long ap_[], const long long ai_[], const double ax[], int threads_)
+    {
+        n = n_;
+        ap = ap_;
+        ai = ai_;
+        threads = threads_;
+        part.assign(n, 0);
+        Dissect(n, ap, ai, tr->Size(), &part[0]);
+        moved = Isolate(n, ap, ai, &part[0]);
+        if (blk.empty()) blk.resize(tr->Size());
+        return Setup(ax);
+    }
+
+    /*
+    * Factorize: factorizes all blocks and the Schur complement with pivoting. Singular blocks are repaired by moving their singular
+    * nodes to the border and analyzing again (see the class comment).
+    * @ax: kept by the solver for Solve, so it must stay valid until the next Factorize or Refactorize
+    */
+    int Factorize(const double ax[])
+    {
+        return FactorizeRepaired(&part[0], moved, [&](std::vector<long long> &bad) { return Numeric(ax, false, &bad); }, [&]() { return Setup(ax); });
+    }
+
+    /*
+    * Refactorize: refactorizes all blocks and the Schur complement without pivoting.
+    * @ax: kept by the solver for Solve, as for Factorize
+    */
+    int Refactorize(const double ax[])
+    {
+        return Numeric(ax, true, NULL);
+    }
+
+    /*
+    * Solve: solves Ax=b with the values last factorized or refactorized. The full solution is gathered in x on rank 0; other ranks
+    * get only their own subdomain entries in x.
+    */
+    int Solve(const double b[], double x[])
+    {
+        const int rank = tr->Rank();
+        BBDBlock<long long> &d = blk[rank];
+
+        //yk=Akk^(-1)*bk, send gk=Abk*yk to rank 0
+        int ret = d.Condense(b, false);
+        Status(ret);
+        Send(0, TAG_RHS, d.g);
+
+        //Rank 0: condensed right-hand-side bb-sum(gk), solve S*xb=g
+        if (0 == rank)
+        {
+            ret = Collect(ret);
+            for (long long r = 0; r < nb; ++r) xb[r] = b[border[r]];
+            for (int k = 0; k < tr->Size(); ++k)
+            {
+                BBDBlock<long long> &o = blk[k];
+                Recv(k, TAG_RHS, o.g);
+                for (size_t r = 0; r < o.brows.size(); ++r) xb[o.brows[r]] -= o.g[r];
+            }
+            if (ret >= 0 && nb > 0) ret = schur->Solve(&xb[0], &xb[0], false, false);
+            for (int k = 0; k < tr->Size(); ++k)
+            {
+                const BBDBlock<long long> &o = blk[k];
+                xc.resize(o.bcols.size());
+                for (size_t c = 0; c < o.bcols.size(); ++c) xc[c] = xb[o.bcols[c]];
+                Send(k, TAG_XB, xc);
+            }
+        }
+
+        //xk=yk-Wk*xb, gather on rank 0
+        xc.resize(d.bcols.size());
+        Recv(0, TAG_XB, xc);
+        for (size_t c = 0; c < d.bcols.size(); ++c) xb[d.bcols[c]] = xc[c];
+        if (ret >= 0) d.BackSubstitute(nb > 0 ? &xb[0] : NULL, x);
+        Send(0, TAG_X, d.y);
+        if (0 == rank)
+        {
+            for (int k = 0; k < tr->Size(); ++k)
+            {
+                BBDBlock<long long> &o = blk[k];
+                Recv(k, TAG_X, o.y);
+                for (size_t l = 0; l < o.glob.size(); ++l) x[o.glob[l]] = o.y[l];
+            }
+            for (long long r = 0; r < nb; ++r) x[border[r]] = xb[r];
+        }
+        return Agree(ret);
+    }
+
+    long long BorderSize() const
+    {
+        return nb;
+    }
+
+    long long LocalSize() const
+    {
+        return (long long)blk[tr->Rank()].glob.size();
+    }
+
+    /*
+    * Moved: # of nodes moved from the subdomains to the border because their blocks were singular.
+    */
+    long long Moved() const
+    {
+        return moved;
+    }
+
+private:
+    enum
+    {
+        TAG_STATUS = 1,
+        TAG_AGREE,
+        TAG_SCHUR,
+        TAG_RHS,
+        TAG_XB,
+        TAG_X,
+        TAG_SINGULAR,
+        TAG_MOVE
+    };
+
+    /*
+    * Setup: splits the blocks and S from part, analyzes the local block, and on rank 0 the Schur complement.
+    */
+    int Setup(const double ax[])
+    {
+        const int size = tr->Size();
+        const int rank = tr->Rank();
+        idx.assign(n, 0);
+        nb = 0;
+        std::vector<long long> cnt(size, 0);
+        for (long long i = 0; i < n; ++i)
+        {
+            if (part[i] < 0) idx[i] = nb++;
+            else idx[i] = cnt[part[i]]++;
+        }
+        border.assign(nb, 0);
+        for (long long i = 0; i < n; ++i)
+        {
+            if (part[i] < 0) border[idx[i]] = i;
+        }
+        xb.resize(nb);
+
+        //Own block, and on rank 0 the coupling structure of all blocks
+        for (int k = 0; k < size; ++k)
+        {
+            if (k == rank || 0 == rank) blk[k].Split(ap, ai, part, k, idx, border);
+        }
+        BBDBlock<long long> &d = blk[rank];
+        int ret = d.Create();
+        if (ret >= 0) ret = d.Analyze(ax, threads);
+        Status(ret);
+        if (0 == rank)
+        {
+            ret = Collect(ret);
+            if (ret >= 0) s.Build(ap, ai, part, idx, border, &blk[0], size);
+            if (ret >= 0 && NULL == schur)
+            {
+                int *iparm;
+                const long long *oparm;
+                ret = CKTSO_L_CreateSolver(&schur, &iparm, &oparm);
+            }
+            if (ret >= 0 && nb > 0) ret = schur->Analyze(false, nb, &s.sp[0], &s.si[0], NULL, threads);
+        }
+        return Agree(ret);
+    }
+
+    /*
+    * Numeric: factorizes or refactorizes the blocks and S.
+    * @bad: if not NULL, gets on all ranks the nodes of the singular rows of the blocks whose factorization returned -6
+    */
+    int Numeric(const double ax[], bool refactor, std::vector<long long> *bad)
+    {
+        const int rank = tr->Rank();
+        BBDBlock<long long> &d = blk[rank];
+
+        //Local block, then its contribution Tk=Abk*Akk^(-1)*Akb (dense, brows x bcols)
+        int ret = d.Eliminate(ax, refactor);
+        Status(ret);
+        Send(0, TAG_SCHUR, d.t);
+        if (NULL != bad)
+        {
+            const long long node = (-6 == ret) ? d.SingularNode() : -1;
+            tr->Send(0, TAG_SINGULAR, &node, sizeof(long long));
+        }
+
+        //Rank 0: assemble and factorize S
+        if (0 == rank)
+        {
+            ret = Collect(ret);
+            for (int k = 0; k < tr->Size(); ++k) Recv(k, TAG_SCHUR, blk[k].t);
+            if (ret >= 0 && nb > 0)
+            {
+                s.Assemble(ax, &blk[0], tr->Size());
+                ret = refactor ? schur->Refactorize(&s.sx[0]) : schur->Factorize(&s.sx[0], false);
+            }
+            if (NULL != bad)
+            {
+                std::vector<long long> nodes(tr->Size(), -1);
+                for (int k = 0; k < tr->Size(); ++k) tr->Recv(k, TAG_SINGULAR, &nodes[k], sizeof(long long));
+                for (int k = 0; k < tr->Size(); ++k) tr->Send(k, TAG_MOVE, &nodes[0], nodes.size() * sizeof(long long));
+            }
+        }
+        if (NULL != bad)
+        {
+            std::vector<long long> nodes(tr->Size(), -1);
+            tr->Recv(0, TAG_MOVE, &nodes[0], nodes.size() * sizeof(long long));
+            for (size_t k = 0; k < nodes.size(); ++k)
+            {
+                if (nodes[k] >= 0) bad->push_back(nodes[k]);
+            }
+        }
+        return Agree(ret);
+    }
+
+    void Send(int dest, int tag, const std::vector<double> &v)
+    {
+        tr->Send(dest, tag, v.empty() ? NULL : &v[0], v.size() * sizeof(double));
+    }
+
+    void Recv(int src, int tag, std::vector<double> &v)
+    {
+        tr->Recv(src, tag, v.empty() ? NULL : &v[0], v.size() * sizeof(double));
+    }
+
+    /*
+    * Status: every rank reports its local return code to rank 0.
+    */
+    void Status(int ret)
+    {
+        tr->Send(0, TAG_STATUS, &ret, sizeof(int));
+    }
+
+    /*
+    * Collect: rank 0, receives all local return codes and keeps the first error.
+    */
+    int Collect(int ret)
+    {
+        for (int k = 0; k < tr->Size(); ++k)
+        {
+            int r = 0;
+            if (tr->Recv(k, TAG_STATUS, &r, sizeof(int)) < 0) r = -2;
+            if (ret >= 0 && r < 0) ret = r;
+        }
+        return ret;
+    }
+
+    /*
+    * Agree: rank 0 broadcasts the final return code so all ranks return the same.
+    */
+    int Agree(int ret)
+    {
+        if (0 == tr->Rank())
+        {
+            for (int k = 0; k < tr->Size(); ++k) tr->Send(k, TAG_AGREE, &ret, sizeof(int));
+        }
+        int r = ret;
+        tr->Recv(0, TAG_AGREE, &r, sizeof(int));
+        return r;
+    }
+
+    Transport *tr;
+    long long n;
+    long long nb; //# of border nodes
+    const long long *ap; //pattern given to Analyze
+    const long long *ai;
+    int threads;
+    long long moved; //# of nodes moved to the border
+    std::vector<long long> part; //subdomain of each node, -1 for the border
+    std::vector<long long> idx; //index of each node within its subdomain or the border
+    std::vector<long long> border; //border nodes
+    std::vector<BBDBlock<long long> > blk; //own subdomain, and on rank 0 the coupling structure of all subdomains
+    BBDSchur<long long> s; //S (rank 0)
+    std::vector<double> xb; //border solution
+    std::vector<double> xc; //border solution on the bcols of a block
+    ICktSo_L schur;
+};
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        printf("Usage: demo_distributed <mtx file> <# of ranks>\n");
+        printf("Example: demo_distributed add20.mtx 4\n");
+        return -1;
+    }
+
+    int n32;
+    int *ap32 = NULL;
+    int *ai32 = NULL;
+    double *ax = NULL;
+    if (!ReadMtxFile(argv[1], n32, ap32, ai32, ax))
+    {
+        delete []ap32;
+        delete []ai32;
+        delete []ax;
+        return -1;
+    }
+    const long long n = n32;
+    const long long nnz = ap32[n];
+    std::vector<long long> ap(ap32, ap32 + n + 1), ai(ai32, ai32 + nnz);
+    delete []ap32;
+    delete []ai32;
+    int ranks = atoi(argv[2]);
+    if (ranks <= 0) ranks = 1;
+
+    std::vector<double> b(n), ax2(nnz);
+    for (long long i = 0; i < n; ++i) b[i] = (double)rand() / RAND_MAX * 100.;
+    for (long long p = 0; p < nnz; ++p) ax2[p] = ax[p] * ((p % 2) ? 1.5 : .8); //new values on the same pattern
+
+    //Each rank runs as a thread over the loopback transport; with MPI every rank would run the same code in its own process
+    LoopbackHub hub(ranks);
+    std::vector<int> rets(ranks, 0);
+    std::vector<long long> sizes(ranks, 0);
+    std::vector<double> x(n, 0.), x2(n, 0.);
+    long long nb = 0, moved = 0;
+    std::vector<std::thread> th;
+    for (int k = 0; k < ranks; ++k)
+    {
+        th.push_back(std::thread([&, k]()
+        {
+            LoopbackTransport tr(&hub, k);
+            DistributedSolver solver(&tr);
+            std::vector<double> xk(n, 0.);
+            int ret = solver.Analyze(n, &ap[0], &ai[0], ax, 1);
+            if (ret >= 0) ret = solver.Factorize(ax);
+            if (ret >= 0) ret = solver.Solve(&b[0], &xk[0]);
+            if (0 == k) x = xk;
+
+            //Values change, pattern is kept: refactorize and solve again
+            if (ret >= 0) ret = solver.Refactorize(&ax2[0]);
+            if (ret >= 0) ret = solver.Solve(&b[0], &xk[0]);
+            if (0 == k)
+            {
+                x2 = xk;
+                nb = solver.BorderSize();
+                moved = solver.Moved();
+            }
+            sizes[k] = solver.LocalSize();
+            rets[k] = ret;
+        }));
+    }
+    for (int k = 0; k < ranks; ++k) th[k].join();
+
+    for (int k = 0; k < ranks; ++k)
+    {
+        if (rets[k] < 0)
+        {
+            printf("Rank %d failed, return code = %d.\n", k, rets[k]);
+            delete []ax;
+            return rets[k];
+        }
+    }
+    printf("Border nodes = %lld, moved to the border for singular blocks = %lld.\n", nb, moved);
+    for (int k = 0; k < ranks; ++k) printf("Rank %d: subdomain nodes = %lld.\n", k, sizes[k]);
+
+    //Calculate residuals (L2 norm) of the gathered solutions
+    double err = 0., err2 = 0.;
+    for (long long r = 0; r < n; ++r)
+    {
+        double s = -b[r], s2 = -b[r];
+        for (long long p = ap[r]; p < ap[r + 1]; ++p)
+        {
+            s += ax[p] * x[ai[p]];
+            s2 += ax2[p] * x2[ai[p]];
+        }
+        err += s * s;
+        err2 += s2 * s2;
+    }
+    printf("Residual after factorization = %g, after refactorization = %g.\n", sqrt(err), sqrt(err2));
+
+    delete []ax;
+    return 0;
+}
@@ -0,0 +1,217 @@
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS		1
+#define _CRT_NONSTDC_NO_WARNINGS	1
+#define _CRT_SECURE_NO_DEPRECATE	1
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <chrono>
+#include <vector>
+#include "cktso.h"
+#include "matvec.h"
+#include "mtxio.h"
+#include "factors.h"
+#ifdef _MSC_VER
+#pragma comment(lib, "cktso.lib")
+#endif
+
+/*
+* FusedSolver: sequential row-mode solve on the factors of ExtractFactors, with the permutation and scaling passes fused into the
+* triangular sweeps (real values).
+* The scaling is folded into the factors once at Compile (FoldedFactors of factors.h), so that they factorize the unscaled permuted
+* matrix and the sweeps do no scaling at all. The forward sweep then gathers b[rperm[i]] as it goes, and the
+* backward sweep scatters x[cperm[i]] as soon as each entry is final: no separate passes over the vectors.
+* SolvePermuted goes further for callers that keep vectors in permuted ordering across time steps (e.g., by stamping the right-
+* hand-side at RowPosition of each row): the vector is solved in place without any gather or scatter.
+* Compile copies the factors, so it pays off when several solves share one factorization; call it after every Factorize or
+* Refactorize.
+* The permuted solve saves only the gather and scatter (2n indirect accesses) of the fused one and is faster by about their cost.
+* Solving v in place rather than through the separate work buffer of Solve makes no measurable difference either way.
+*/
+class FusedSolver
+{
+public:
+    FusedSolver() : n(0)
+    {
+    }
+
+    /*
+    * Compile: extracts and prepares the factors (call this routine after matrix has been factorized or refactorized).
+    * @iparm, oparm: parameters of inst, iparm[7] must be the one used at analysis
+    * @return: <0 for error
+    */
+    int Compile(ICktSo inst, const int iparm[], const long long oparm[], int n_)
+    {
+        n = n_;
+        const int ret = f.Build(inst, iparm, oparm, n);
+        if (ret < 0) return ret;
+        pos.resize(n);
+        for (int i = 0; i < n; ++i) pos[f.rperm[i]] = i;
+        work.resize(n);
+        return ret;
+    }
+
+    /*
+    * Solve: solves A*x=b, x can be the same address as b.
+    */
+    void Solve(const double b[], double x[])
+    {
+        double *w = &work[0];
+        for (int i = 0; i < n; ++i)
+        {
+            double s = b[f.rperm[i]];
+            for (size_t p = f.lp[i]; p < f.lp[i + 1]; ++p) s -= f.lx[p] * w[f.li[p]];
+            w[i] = s * f.invd[i];
+        }
+        for (int i = n - 1; i >= 0; --i)
+        {
+            double s = w[i];
+            for (size_t p = f.up[i]; p < f.up[i + 1]; ++p) s -= f.ux[p] * w[f.ui[p]];
+            w[i] = s;
+            x[f.cperm[i]] = s;
+        }
+    }
+
+    /*
+    * SolvePermuted: solves in permuted ordering in place. On input v[i]=b[rperm[i]], on output v[i]=x[cperm[i]].
+    */
+    void SolvePermuted(double v[]) const
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            double s = v[i];
+            for (size_t p = f.lp[i]; p < f.lp[i + 1]; ++p) s -= f.lx[p] * v[f.li[p]];
+            v[i] = s * f.invd[i];
+        }
+        for (int i = n - 1; i >= 0; --i)
+        {
+            double s = v[i];
+            for (size_t p = f.up[i]; p < f.up[i + 1]; ++p) s -= f.ux[p] * v[f.ui[p]];
+            v[i] = s;
+        }
+    }
+
+    /*
+    * RowPosition: position of each original row in permuted right-hand-side vectors (inverse of rperm).
+    * ColumnOrder: original index of each entry of permuted solution vectors (cperm).
+    */
+    const int *RowPosition() const
+    {
+        return &pos[0];
+    }
+
+    const int *ColumnOrder() const
+    {
+        return &f.cperm[0];
+    }
+
+private:
+    int n;
+    FoldedFactors f;
+    std::vector<int> pos;
+    std::vector<double> work;
+};
+
+static long long Now()
+{
+    return (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: demo_fusedsolve <mtx file> [scaling (iparm[7])]\n");
+        printf("Example: demo_fusedsolve add20.mtx 1\n");
+        return -1;
+    }
+
+    int n;
+    std::vector<int> ap, ai;
+    std::vector<double> ax;
+    bool is_complex;
+    int ret = LoadMatrix(argv[1], n, ap, ai, ax, is_complex, 0);
+    if (ret < 0)
+    {
+        printf("Cannot load matrix file \"%s\", return code = %d.\n", argv[1], ret);
+        return ret;
+    }
+    if (is_complex)
+    {
+        printf("Matrix \"%s\" is complex.\n", argv[1]);
+        return -2;
+    }
+
+    ICktSo instance = NULL;
+    int *iparm;
+    const long long *oparm;
+    ret = CKTSO_CreateSolver(&instance, &iparm, &oparm);
+    if (ret < 0)
+    {
+        printf("Failed to create solver instance, return code = %d.\n", ret);
+        return ret;
+    }
+    iparm[0] = 1;
+    if (argc > 2) iparm[7] = atoi(argv[2]);
+    ret = instance->Analyze(false, n, ap.data(), ai.data(), ax.data(), 1);
+    if (ret >= 0) ret = instance->Factorize(ax.data(), false);
+    if (ret < 0)
+    {
+        printf("Failed to analyze or factorize matrix, return code = %d.\n", ret);
+        instance->DestroySolver();
+        return ret;
+    }
+
+    FusedSolver fused;
+    long long t0 = Now();
+    ret = fused.Compile(instance, iparm, oparm, n);
+    const long long compile = Now() - t0;
+    if (ret < 0)
+    {
+        printf("Failed to extract factors, return code = %d.\n", ret);
+        instance->DestroySolver();
+        return ret;
+    }
+
+    std::vector<double> b(n), x(n), xf(n), xp(n), v(n);
+    for (int i = 0; i < n; ++i) b[i] = (double)rand() / RAND_MAX * 100.;
+    ParallelMatVec<int> mv;
+    mv.Initialize(n, ap.data(), ai.data(), false, 1);
+    const int reps = 1000;
+
+    //The three solves are timed in turn in one loop, so that they see the same machine state; timing each in its own loop made
+    //their order decide which looked faster. For the permuted solve, the right-hand-side is stamped at permuted positions and the
+    //solution is read in permuted order
+    const int *pos = fused.RowPosition();
+    const int *order = fused.ColumnOrder();
+    long long lib = LLONG_MAX, fs = LLONG_MAX, ps = LLONG_MAX;
+    for (int r = 0; r < reps; ++r)
+    {
+        t0 = Now();
+        instance->Solve(b.data(), x.data(), true, false);
+        long long t = Now() - t0;
+        if (t < lib) lib = t;
+
+        t0 = Now();
+        fused.Solve(b.data(), xf.data());
+        t = Now() - t0;
+        if (t < fs) fs = t;
+
+        for (int i = 0; i < n; ++i) v[pos[i]] = b[i]; //stands for stamping, not timed
+        t0 = Now();
+        fused.SolvePermuted(v.data());
+        t = Now() - t0;
+        if (t < ps) ps = t;
+    }
+    for (int i = 0; i < n; ++i) xp[order[i]] = v[i];
+    printf("Library sequential solve: min time = %.3f us, residual = %g.\n", lib * 1e-3, mv.Residual(ax.data(), x.data(), b.data(), NULL, false, NULL));
+    printf("Fused solve: min time = %.3f us, residual = %g.\n", fs * 1e-3, mv.Residual(ax.data(), xf.data(), b.data(), NULL, false, NULL));
+    printf("Permuted-ordering solve: min time = %.3f us, residual = %g.\n", ps * 1e-3, mv.Residual(ax.data(), xp.data(), b.data(), NULL, false,
+        NULL));
+    printf("Compile time = %.3f us (once per factorization).\n", compile * 1e-3);
+
+    instance->DestroySolver();
+    return 0;
+}
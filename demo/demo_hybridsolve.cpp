@@ -0,0 +1,109 @@
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS		1
+#define _CRT_NONSTDC_NO_WARNINGS	1
+#define _CRT_SECURE_NO_DEPRECATE	1
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "cktso.h"
+#include "matvec.h"
+#include "mtxio.h"
+#include "hybridsolve.h"
+#ifdef _MSC_VER
+#pragma comment(lib, "cktso.lib")
+#endif
+
+/*
+* Builds the level schedule of hybridsolve.h for one factorization, calibrates it against the sequential and parallel Solve of the
+* library, and reports the schedule, the time of each path, the chosen path and the residual of a solve by it, also after a
+* refactorization, which keeps the chosen path.
+*/
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: demo_hybridsolve <mtx file> [# of threads] [scaling (iparm[7])]\n");
+        printf("Example: demo_hybridsolve add20.mtx 0 1\n");
+        return -1;
+    }
+    const int threads = argc > 2 ? atoi(argv[2]) : 0;
+
+    int n;
+    std::vector<int> ap, ai;
+    std::vector<double> ax;
+    bool is_complex;
+    int ret = LoadMatrix(argv[1], n, ap, ai, ax, is_complex, 0);
+    if (ret < 0)
+    {
+        printf("Cannot load matrix file \"%s\", return code = %d.\n", argv[1], ret);
+        return ret;
+    }
+    if (is_complex)
+    {
+        printf("Matrix \"%s\" is complex.\n", argv[1]);
+        return -2;
+    }
+
+    ICktSo instance = NULL;
+    int *iparm;
+    const long long *oparm;
+    ret = CKTSO_CreateSolver(&instance, &iparm, &oparm);
+    if (ret < 0)
+    {
+        printf("Failed to create solver instance, return code = %d.\n", ret);
+        return ret;
+    }
+    if (argc > 3) iparm[7] = atoi(argv[3]);
+    ret = instance->Analyze(false, n, ap.data(), ai.data(), ax.data(), threads);
+    if (ret >= 0) ret = instance->Factorize(ax.data(), false);
+    if (ret < 0)
+    {
+        printf("Failed to analyze or factorize matrix, return code = %d.\n", ret);
+        instance->DestroySolver();
+        return ret;
+    }
+
+    std::vector<double> b(n), x(n);
+    for (int i = 0; i < n; ++i) b[i] = (double)rand() / RAND_MAX * 100.;
+
+    //Level schedule built once for these factors, calibrated against the sequential and parallel library solves
+    HybridSolver hybrid;
+    ret = hybrid.Compile(instance, iparm, oparm, n, threads, 0);
+    if (ret >= 0) ret = hybrid.Calibrate(b.data(), 20);
+    if (ret < 0)
+    {
+        printf("Failed to build or calibrate the hybrid solve, return code = %d.\n", ret);
+        instance->DestroySolver();
+        return ret;
+    }
+    int levels, wide_levels, wide_rows, syncs;
+    hybrid.Statistics(&levels, &wide_levels, &wide_rows, &syncs);
+    printf("Solve schedule: %d threads, %d levels, %d wide levels with %d of %d rows, %d syncs.\n", hybrid.Threads(), levels, wide_levels,
+        wide_rows, n + n, syncs);
+    printf("Solve min time: sequential = %.3f us, parallel = %.3f us, hybrid = %.3f us, chosen = %s.\n",
+        hybrid.Time(HybridSolver::PATH_SEQUENTIAL) * 1e-3, hybrid.Time(HybridSolver::PATH_PARALLEL) * 1e-3,
+        hybrid.Time(HybridSolver::PATH_HYBRID) * 1e-3, HybridSolver::PathName(hybrid.Path()));
+
+    ParallelMatVec<int> mv;
+    mv.Initialize(n, ap.data(), ai.data(), false, threads);
+    ret = hybrid.Solve(b.data(), x.data());
+    if (ret >= 0) printf("Residual of the chosen path = %g.\n", mv.Residual(ax.data(), x.data(), b.data(), NULL, false, NULL));
+
+    //Refactorization keeps the pattern: Compile rebuilds the schedule and keeps the calibrated path and the worker threads
+    ret = instance->Refactorize(ax.data());
+    if (ret >= 0) ret = hybrid.Compile(instance, iparm, oparm, n, threads, 0);
+    if (ret >= 0) ret = hybrid.Solve(b.data(), x.data());
+    if (ret >= 0) printf("After refactorization: path = %s, residual = %g.\n", HybridSolver::PathName(hybrid.Path()),
+        mv.Residual(ax.data(), x.data(), b.data(), NULL, false, NULL));
+
+    //The hybrid path itself, whichever was chosen
+    hybrid.SetPath(HybridSolver::PATH_HYBRID);
+    ret = hybrid.Solve(b.data(), x.data());
+    if (ret >= 0) printf("Residual of the hybrid path = %g.\n", mv.Residual(ax.data(), x.data(), b.data(), NULL, false, NULL));
+
+    instance->DestroySolver();
+    return 0;
+}
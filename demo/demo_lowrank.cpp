@@ -0,0 +1,377 @@
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS		1
+#define _CRT_NONSTDC_NO_WARNINGS	1
+#define _CRT_SECURE_NO_DEPRECATE	1
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "cktso.h"
+#ifdef _MSC_VER
+#pragma comment(lib, "cktso.lib")
+#endif
+
+/*
+* Low-rank update solve (Sherman-Morrison-Woodbury) on top of existing LU factors (real matrices, row mode).
+* When only a few entries of A change (e.g., a switch toggles), A' = A + U*V^T, where V has one unit column per changed matrix column
+* and U holds the value changes of that column. Then
+*     x = A'^(-1)*b = y - Z*C^(-1)*V^T*y, with y = A^(-1)*b, Z = A^(-1)*U, C = I + V^T*Z.
+* Z is computed once per registered update (one SolveMV with rank right-hand-side vectors), and each solve costs one Solve plus
+* a small dense correction. If the rank is too large or C is singular or ill-conditioned (the correction would lose accuracy),
+* the update falls back to a pivoting factorization of the new values.
+*/
+class LowRankUpdate
+{
+public:
+    LowRankUpdate() : inst(NULL), oparm(NULL), n(0), ap(NULL), ai(NULL), row(NULL), ax0(NULL), col(NULL), z(NULL), c(NULL), piv(NULL), w(NULL), rank(0), max_rank(0), factor_time(0), solve_time(0)
+    {
+    }
+
+    ~LowRankUpdate()
+    {
+        delete []row;
+        delete []ax0;
+        delete []col;
+        delete []z;
+        delete []c;
+        delete []piv;
+        delete []w;
+    }
+
+    /*
+    * Initialize: binds an analyzed and factorized instance. ax is the matrix value array that was factorized.
+    * @max_rank: largest rank handled by the correction, 0 means automatic threshold from measured refactorization and solve times (needs iparm[0] != 0)
+    */
+    bool Initialize(ICktSo instance, const long long oparm_[], int n_, const int ap_[], const int ai_[], const double ax[], int max_rank_)
+    {
+        inst = instance;
+        oparm = oparm_;
+        factor_time = oparm[1];
+        solve_time = 0;
+        n = n_;
+        ap = ap_;
+        ai = ai_;
+        max_rank = max_rank_;
+        const int nnz = ap[n];
+        row = new int [nnz];
+        ax0 = new double [nnz];
+        col = new int [n];
+        w = new double [n];
+        if (NULL == row || NULL == ax0 || NULL == col || NULL == w) return false;
+        for (int i = 0; i < n; ++i)
+        {
+            for (int p = ap[i]; p < ap[i + 1]; ++p) row[p] = i;
+        }
+        memcpy(ax0, ax, sizeof(double) * nnz);
+        rank = 0;
+        return true;
+    }
+
+    /*
+    * Update: registers changed entries of the matrix.
+    * @ax: new matrix values (all entries, the same layout as the analyzed matrix)
+    * @k: number of changed entries
+    * @changed: indexes (into ax) of changed entries. Changes are always measured against the last factorized values
+    * @return: 0 if the low-rank correction is used, 1 if the matrix was refactorized because the rank is above the limit, 2 if it
+    * was refactorized because C is singular or nearly singular, <0 for error
+    */
+    int Update(const double ax[], int k, const int changed[])
+    {
+        //Distinct columns touched by the changes determine the rank
+        rank = 0;
+        for (int t = 0; t < k; ++t)
+        {
+            const int j = ai[changed[t]];
+            int r = 0;
+            while (r < rank && col[r] != j) ++r;
+            if (r == rank) col[rank++] = j;
+        }
+        if (0 == rank) return 0;
+
+        //Automatic threshold: building Z costs rank solves, which should be cheaper than one refactorization
+        int limit = max_rank;
+        if (limit <= 0)
+        {
+            const long long ts = solve_time > 0 ? solve_time : 1;
+            limit = (factor_time > 0) ? (int)(factor_time / ts) : 16;
+            if (limit < 1) limit = 1;
+        }
+        if (rank > limit) return Refactor(ax, 1);
+
+        delete []z;
+        delete []c;
+        delete []piv;
+        z = new double [(size_t)n * rank];
+        c = new double [(size_t)rank * rank];
+        piv = new int [rank];
+        if (NULL == z || NULL == c || NULL == piv)
+        {
+            rank = 0;
+            return -4;
+        }
+
+        //U: column r holds the value changes in matrix column col[r]
+        memset(z, 0, sizeof(double) * n * rank);
+        for (int t = 0; t < k; ++t)
+        {
+            const int p = changed[t];
+            int r = 0;
+            while (col[r] != ai[p]) ++r;
+            z[(size_t)r * n + row[p]] += ax[p] - ax0[p];
+        }
+        int ret = inst->SolveMV(rank, z, n, z, n, false);
+        if (ret < 0)
+        {
+            rank = 0;
+            return ret;
+        }
+
+        //C = I + V^T*Z, factorized by LU with partial pivoting
+        for (int r = 0; r < rank; ++r)
+        {
+            for (int s = 0; s < rank; ++s)
+            {
+                c[r * rank + s] = z[(size_t)s * n + col[r]] + (r == s ? 1. : 0.);
+            }
+        }
+        double dmax = 0., dmin = 0.;
+        for (int j = 0; j < rank; ++j)
+        {
+            int p = j;
+            for (int i = j + 1; i < rank; ++i)
+            {
+                if (fabs(c[i * rank + j]) > fabs(c[p * rank + j])) p = i;
+            }
+            piv[j] = p;
+            if (p != j)
+            {
+                for (int s = 0; s < rank; ++s)
+                {
+                    const double t = c[j * rank + s];
+                    c[j * rank + s] = c[p * rank + s];
+                    c[p * rank + s] = t;
+                }
+            }
+            const double d = c[j * rank + j];
+            if (0 == j || fabs(d) > dmax) dmax = fabs(d);
+            if (0 == j || fabs(d) < dmin) dmin = fabs(d);
+            if (0. == d) return Refactor(ax, 2);
+            for (int i = j + 1; i < rank; ++i)
+            {
+                const double l = (c[i * rank + j] /= d);
+                for (int s = j + 1; s < rank; ++s) c[i * rank + s] -= l * c[j * rank + s];
+            }
+        }
+
+        //A nearly singular C means the correction loses accuracy, so refactorize instead
+        if (dmin < dmax * 1e-8) return Refactor(ax, 2);
+        return 0;
+    }
+
+    /*
+    * Solve: solves A'x=b with the factors of A and the registered low-rank correction.
+    */
+    int Solve(const double b[], double x[])
+    {
+        int ret = inst->Solve(b, x, false, false);
+        if (ret < 0) return ret;
+        solve_time = oparm[2];
+        if (0 == rank) return 0;
+        for (int r = 0; r < rank; ++r) w[r] = x[col[r]];
+        for (int j = 0; j < rank; ++j)
+        {
+            const int p = piv[j];
+            if (p != j)
+            {
+                const double t = w[j];
+                w[j] = w[p];
+                w[p] = t;
+            }
+        }
+        for (int i = 0; i < rank; ++i)
+        {
+            for (int s = 0; s < i; ++s) w[i] -= c[i * rank + s] * w[s];
+        }
+        for (int i = rank - 1; i >= 0; --i)
+        {
+            for (int s = i + 1; s < rank; ++s) w[i] -= c[i * rank + s] * w[s];
+            w[i] /= c[i * rank + i];
+        }
+        for (int r = 0; r < rank; ++r)
+        {
+            const double *zr = z + (size_t)r * n;
+            const double t = w[r];
+            for (int i = 0; i < n; ++i) x[i] -= zr[i] * t;
+        }
+        return 0;
+    }
+
+    int Rank() const
+    {
+        return rank;
+    }
+
+private:
+    //Large changes can make the old pivots unstable, so the fallback pivots again (reusing the pivots that are still good)
+    int Refactor(const double ax[], int reason)
+    {
+        rank = 0;
+        const int ret = inst->Factorize(ax, true);
+        if (ret < 0) return ret;
+        factor_time = oparm[1];
+        memcpy(ax0, ax, sizeof(double) * ap[n]);
+        return reason;
+    }
+
+    ICktSo inst;
+    const long long *oparm;
+    int n;
+    const int *ap;
+    const int *ai;
+    int *row; //row index of each nonzero
+    double *ax0; //values of the last factorized matrix
+    int *col; //changed columns (columns of V)
+    double *z; //Z=A^(-1)*U, rank vectors of length n
+    double *c; //LU factors of C=I+V^T*Z
+    int *piv;
+    double *w;
+    int rank;
+    int max_rank;
+    long long factor_time; //last measured factorization time
+    long long solve_time; //last measured solve time
+};
+
+/*
+* BackwardError: |A*x-b|_inf / (|A|_inf*|x|_inf + |b|_inf), about machine precision for a correct solution.
+*/
+double BackwardError(int n, const int ap[], const int ai[], const double ax[], const double x[], const double b[])
+{
+    double r = 0., a = 0., xm = 0., bm = 0.;
+    for (int i = 0; i < n; ++i)
+    {
+        double s = -b[i], t = 0.;
+        for (int p = ap[i]; p < ap[i + 1]; ++p)
+        {
+            s += ax[p] * x[ai[p]];
+            t += fabs(ax[p]);
+        }
+        if (fabs(s) > r) r = fabs(s);
+        if (t > a) a = t;
+        if (fabs(x[i]) > xm) xm = fabs(x[i]);
+        if (fabs(b[i]) > bm) bm = fabs(b[i]);
+    }
+    return r / (a * xm + bm);
+}
+
+int main()
+{
+    static const char *path[3] = { "low-rank correction", "refactorized, rank above limit", "refactorized, C nearly singular" };
+    int ret;
+    int n = 6;
+    double ax[13] = { 1.1, -7.7, 13.13, 2.2, 9.9, 8.8, -3.3, -4.4,
+        11.11, 5.5, 10.1, 12.12, 6.6 };
+    int ai[13] = { 0, 3, 4, 1, 4, 1, 2, 3, 2, 4, 0, 3, 5 };
+    int ap[7] = { 0, 3, 5, 7, 8, 10, 13 };
+    double b[6] = { 35.95, 53.9, 7.7, -17.6, 60.83, 98.18 };
+    double x[6];
+    int iter = 6;
+
+    //Create solver instance
+    ICktSo instance = nullptr;
+    int *iparm;
+    const long long *oparm;
+    ret = CKTSO_CreateSolver(&instance, &iparm, &oparm);
+    if (ret < 0)
+    {
+        printf("Failed to create solver instance, return code = %d.\n", ret);
+        return ret;
+    }
+    iparm[0] = 1; //enable high-precision timer, used by the automatic rank threshold
+
+    //Analyze and factorize the initial matrix
+    ret = instance->Analyze(false, n, ap, ai, ax, 1);
+    if (ret >= 0) ret = instance->Factorize(ax, true);
+    if (ret < 0)
+    {
+        printf("Failed to analyze or factorize matrix, return code = %d.\n", ret);
+        instance->DestroySolver();
+        return ret;
+    }
+
+    //Rank limit 2 here, so that the last cases go over it (0 sets the limit from measured times)
+    const double ax_init[13] = { 1.1, -7.7, 13.13, 2.2, 9.9, 8.8, -3.3, -4.4, 11.11, 5.5, 10.1, 12.12, 6.6 };
+    LowRankUpdate lru;
+    if (!lru.Initialize(instance, oparm, n, ap, ai, ax, 2))
+    {
+        printf("Failed to initialize low-rank update.\n");
+        instance->DestroySolver();
+        return -4;
+    }
+    lru.Solve(b, x);
+
+    //A switch toggling changes a few stamps. Here entries (0,0), (0,3) and (3,3) model the switch conductance
+    const int changed[3] = { 0, 1, 7 };
+    for (int j = 0; j < iter; ++j)
+    {
+        const double g = (j & 1) ? 1e3 : 1e-3;
+        ax[0] = 1.1 + g;
+        ax[1] = -7.7 - g;
+        ax[7] = -4.4 + g;
+
+        ret = lru.Update(ax, 3, changed);
+        if (ret < 0)
+        {
+            printf("Failed to update matrix, return code = %d.\n", ret);
+            instance->DestroySolver();
+            return ret;
+        }
+        ret = lru.Solve(b, x);
+        if (ret < 0)
+        {
+            printf("Failed to solve linear system, return code = %d.\n", ret);
+            instance->DestroySolver();
+            return ret;
+        }
+
+        printf("Step [%d]: %s (rank %d), backward error = %g.\n", j, path[ret], lru.Rank(), BackwardError(n, ap, ai, ax, x, b));
+    }
+
+    //Fallbacks, each checked against the updated matrix. Changes are registered against the last factorized values:
+    //(a) the switch stays on and another element changes (4,2): columns 0, 2 and 3, rank 3 is above the limit
+    //(b) a huge conductance at (0,0) together with a small change at (3,3): the pivots of C are more than 8 orders of magnitude
+    //    apart, so the correction is not trusted although the updated matrix is not singular
+    const int changed_a[4] = { 0, 1, 7, 8 };
+    const int changed_b[2] = { 0, 7 };
+    for (int j = 0; j < 2; ++j)
+    {
+        const int k = (0 == j) ? 4 : 2;
+        const int *changed_j = (0 == j) ? changed_a : changed_b;
+        if (0 == j) ax[8] = ax_init[8] - 1e3;
+        else
+        {
+            ax[0] += 1e13;
+            ax[7] += 1.;
+        }
+        ret = lru.Update(ax, k, changed_j);
+        if (ret >= 0) ret = lru.Solve(b, x) < 0 ? -1 : ret;
+        if (ret < 0)
+        {
+            printf("Failed to update or solve, return code = %d.\n", ret);
+            instance->DestroySolver();
+            return ret;
+        }
+        const double berr = BackwardError(n, ap, ai, ax, x, b);
+        printf("Case (%c): %s, backward error = %g (%s).\n", 'a' + j, path[ret], berr, berr < 1e-12 ? "correct" : "WRONG");
+    }
+
+    //(c) the only entry of row 3 drops to zero: C is singular because the updated matrix is, and the fallback factorization
+    //    reports the singular matrix instead of returning a wrong solution
+    const int changed_c[1] = { 7 };
+    ax[7] = 0.;
+    ret = lru.Update(ax, 1, changed_c);
+    printf("Case (c): singular update, return code = %d (%s).\n", ret, ret < 0 ? "expected" : "WRONG");
+
+    instance->DestroySolver();
+    return 0;
+}
@@ -0,0 +1,171 @@
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS		1
+#define _CRT_NONSTDC_NO_WARNINGS	1
+#define _CRT_SECURE_NO_DEPRECATE	1
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "cktso.h"
+#include "mtxio.h"
+#include "matvec.h"
+#ifdef _MSC_VER
+#pragma comment(lib, "cktso.lib")
+#endif
+
+/*
+* SolveRefined: solves Ax=b and improves x by iterative refinement (call this routine after matrix has been factorized or refactorized).
+* Refinement stops when the componentwise backward error drops below tol, when it stagnates (the backward error is not at least
+* halved), or after maxiter steps.
+* @mv: parallel SpMV bound to the analyzed matrix, used for residuals
+* @work: buffer of length 2n
+* @steps: number of refinement steps performed
+* @resnorm: L2 norm of the final residual
+* @berr: componentwise backward error of the final solution
+* @return: 0 if converged, 1 if not converged (the factors are not accurate enough, re-factorize with pivoting), <0 for error
+*/
+int SolveRefined(ICktSo inst, ParallelMatVec<int> &mv, const int n, const double ax[], const double b[], double x[],
+    double work[], int maxiter, double tol, int *steps, double *resnorm, double *berr)
+{
+    double *r = work;
+    double *d = work + n;
+
+    *steps = 0;
+    int ret = inst->Solve(b, x, false, false);
+    if (ret < 0) return ret;
+    double be;
+    double rn = mv.Residual(ax, x, b, r, false, &be);
+    for (;;)
+    {
+        *resnorm = rn;
+        *berr = be;
+        if (be <= tol) return 0;
+        if (*steps >= maxiter) return 1;
+
+        ret = inst->Solve(r, d, false, false);
+        if (ret < 0) return ret;
+        for (int i = 0; i < n; ++i) d[i] += x[i];
+        double be2;
+        const double rn2 = mv.Residual(ax, d, b, r, false, &be2);
+        ++*steps;
+        if (!(be2 < be)) return 1; //diverged, keep the previous solution
+        memcpy(x, d, sizeof(double) * n);
+        if (be2 > be * .5)
+        {
+            *resnorm = rn2;
+            *berr = be2;
+            return (be2 <= tol) ? 0 : 1;
+        }
+        rn = rn2;
+        be = be2;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        printf("Usage: demo_refine <mtx file> <# of threads>\n");
+        printf("Example: demo_refine add20.mtx 4\n");
+        return -1;
+    }
+
+    int n;
+    int *ap = NULL;
+    int *ai = NULL;
+    double *ax = NULL;
+    if (!ReadMtxFile(argv[1], n, ap, ai, ax))
+    {
+        delete []ap;
+        delete []ai;
+        delete []ax;
+        return -1;
+    }
+    const int nnz = ap[n];
+    double *cx = new double [nnz]; //original values
+    double *b = new double [n * 4];
+    double *x = b + n;
+    double *work = x + n;
+    if (NULL == cx || NULL == b)
+    {
+        printf("Malloc for vectors failed.\n");
+        delete []ap;
+        delete []ai;
+        delete []ax;
+        delete []cx;
+        delete []b;
+        return -1;
+    }
+    memcpy(cx, ax, sizeof(double) * nnz);
+    for (int i = 0; i < n; ++i) b[i] = (double)rand() / RAND_MAX * 100.;
+
+    ICktSo instance = NULL;
+    int *iparm;
+    const long long *oparm;
+    int ret = CKTSO_CreateSolver(&instance, &iparm, &oparm);
+    if (ret < 0)
+    {
+        printf("Failed to create solver instance, return code = %d.\n", ret);
+        delete []ap;
+        delete []ai;
+        delete []ax;
+        delete []cx;
+        delete []b;
+        return ret;
+    }
+
+    ret = instance->Analyze(false, n, ap, ai, ax, atoi(argv[2]));
+    if (ret >= 0) ret = instance->Factorize(ax, false);
+    if (ret < 0)
+    {
+        printf("Failed to analyze or factorize matrix, return code = %d.\n", ret);
+        delete []ap;
+        delete []ai;
+        delete []ax;
+        delete []cx;
+        delete []b;
+        instance->DestroySolver();
+        return ret;
+    }
+
+    ParallelMatVec<int> mv;
+    mv.Initialize(n, ap, ai, false, atoi(argv[2]));
+
+    //Simulate Newton-Raphson iterations: values change, Refactorize is always tried first and
+    //Factorize is called only when iterative refinement fails to converge
+    for (int j = 0; j < 10; ++j)
+    {
+        const double spread = (j < 5) ? 1.1 : 1e14;
+        for (int p = 0; p < nnz; ++p)
+        {
+            ax[p] = cx[p] * pow(spread, (double)rand() / RAND_MAX - .5);
+        }
+
+        int steps;
+        double resnorm, berr;
+        ret = instance->Refactorize(ax);
+        if (ret >= 0) ret = SolveRefined(instance, mv, n, ax, b, x, work, 5, 1e-14, &steps, &resnorm, &berr);
+        const char *path = "refactorization";
+        if (ret != 0)
+        {
+            path = "factorization (refinement failed after refactorization)";
+            ret = instance->Factorize(ax, true);
+            if (ret >= 0) ret = SolveRefined(instance, mv, n, ax, b, x, work, 5, 1e-14, &steps, &resnorm, &berr);
+        }
+        if (ret < 0)
+        {
+            printf("Failed to factorize or solve, return code = %d.\n", ret);
+            break;
+        }
+        printf("Iteration [%d]: %s, refinement steps = %d, residual = %g, backward error = %g%s.\n", j, path, steps, resnorm, berr, 0 == ret ? "" : " (not converged)");
+    }
+
+    delete []ap;
+    delete []ai;
+    delete []ax;
+    delete []cx;
+    delete []b;
+    instance->DestroySolver();
+    return 0;
+}
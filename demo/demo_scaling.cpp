@@ -0,0 +1,147 @@
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS		1
+#define _CRT_NONSTDC_NO_WARNINGS	1
+#define _CRT_SECURE_NO_DEPRECATE	1
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <vector>
+#include "cktso.h"
+#include "matvec.h"
+#include "mtxio.h"
+#include "scaling.h"
+#ifdef _MSC_VER
+#pragma comment(lib, "cktso.lib")
+#endif
+
+/*
+* Measures the cost of the scaling preprocessing separately from the rest of analysis, and compares the matching-based scaling of
+* the library (iparm[7]) with the parallel equilibration of scaling.h at several quality levels (# of iterations).
+* iparm[7] runs inside CKTSO_Analyze, so its cost is only seen as the difference of analysis time over the unscaled run. The
+* difference also includes changes of ordering time on the scaled matrix, and is reported together with the spread of repeated
+* unscaled analyses, below which it is noise.
+*/
+
+struct Config
+{
+    const char *name;
+    int iparm7; //library scaling
+    int iterations; //parallel equilibration, 0 for none
+};
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: demo_scaling <mtx file> [# of threads]\n");
+        printf("Example: demo_scaling add20.mtx 0\n");
+        return -1;
+    }
+    const int threads = argc > 2 ? atoi(argv[2]) : 0;
+
+    int n;
+    std::vector<int> ap, ai;
+    std::vector<double> ax;
+    bool is_complex;
+    int ret = LoadMatrix(argv[1], n, ap, ai, ax, is_complex, 0);
+    if (ret < 0)
+    {
+        printf("Cannot load matrix file \"%s\", return code = %d.\n", argv[1], ret);
+        return ret;
+    }
+    if (is_complex)
+    {
+        printf("Matrix \"%s\" is complex.\n", argv[1]);
+        return -2;
+    }
+
+    std::vector<double> b(n), sb(n), x(n), sx(ax.size());
+    for (int i = 0; i < n; ++i) b[i] = (double)rand() / RAND_MAX * 100.;
+    ParallelMatVec<int> mv;
+    mv.Initialize(n, ap.data(), ai.data(), false, threads);
+    ParallelScaling<int> scaling;
+    scaling.Initialize(n, ap.data(), ai.data(), threads);
+
+    ICktSo instance = NULL;
+    int *iparm;
+    const long long *oparm;
+    ret = CKTSO_CreateSolver(&instance, &iparm, &oparm);
+    if (ret < 0)
+    {
+        printf("Failed to create solver instance, return code = %d.\n", ret);
+        return ret;
+    }
+    iparm[0] = 1;
+
+    const Config configs[] =
+    {
+        { "none", 0, 0 },
+        { "matching (iparm[7]=1)", 1, 0 },
+        { "matching+column (iparm[7]=-1)", -1, 0 },
+        { "equilibration x1", 0, 1 },
+        { "equilibration x3", 0, 3 },
+        { "equilibration x10", 0, 10 },
+    };
+    const int nconfig = sizeof(configs) / sizeof(Config);
+    printf("Threads = %d.\n", scaling.Threads());
+    printf("%-30s %12s %12s %12s %12s %12s %12s\n", "scaling", "equil(us)", "analyze(us)", "delta(us)", "factor(us)", "nnz(L+U)",
+        "backward err");
+    long long base = -1, noise = 0;
+    for (int c = 0; c < nconfig; ++c)
+    {
+        const Config &cfg = configs[c];
+        const double *vals = ax.data();
+        if (cfg.iterations > 0)
+        {
+            scaling.Compute(ax.data(), false, cfg.iterations);
+            scaling.Apply(ax.data(), sx.data(), false);
+            vals = sx.data();
+        }
+        iparm[7] = cfg.iparm7;
+        long long analyze = LLONG_MAX, slowest = 0;
+        for (int r = 0; r < 3; ++r) //min of a few runs, since the library scaling cost is a difference of analysis times
+        {
+            ret = instance->Analyze(false, n, ap.data(), ai.data(), vals, threads);
+            if (ret < 0) break;
+            if (oparm[0] < analyze) analyze = oparm[0];
+            if (oparm[0] > slowest) slowest = oparm[0];
+        }
+        long long factor = LLONG_MAX;
+        for (int r = 0; r < 10 && ret >= 0; ++r)
+        {
+            ret = instance->Factorize(vals, false);
+            if (oparm[1] < factor) factor = oparm[1];
+        }
+        if (ret < 0)
+        {
+            printf("%-30s failed, return code = %d.\n", cfg.name, ret);
+            continue;
+        }
+        if (cfg.iterations > 0)
+        {
+            scaling.ScaleRhs(b.data(), sb.data(), false);
+            instance->Solve(sb.data(), x.data(), false, false);
+            scaling.ScaleSolution(x.data(), x.data(), false);
+        }
+        else instance->Solve(b.data(), x.data(), false, false);
+        double berr;
+        mv.Residual(ax.data(), x.data(), b.data(), NULL, false, &berr);
+        if (0 == c)
+        {
+            base = analyze;
+            noise = slowest - analyze;
+        }
+        char equil[24] = "-", delta[24] = "-";
+        if (cfg.iterations > 0) sprintf(equil, "%lld", scaling.Time());
+        if (c > 0 && base >= 0) sprintf(delta, "%lld", analyze > base ? analyze - base : 0); //clamped, a faster analysis is noise
+        printf("%-30s %12s %12lld %12s %12lld %12lld %12.3g\n", cfg.name, equil, analyze, delta, factor, oparm[5] + oparm[6], berr);
+    }
+    printf("equil: time of the parallel equilibration, outside analysis.\n");
+    printf("delta: analysis time over the unscaled run (min of 3 runs each, clamped at 0), the only visible cost of iparm[7].\n");
+    printf("The unscaled analyses spread over %lld us, smaller deltas are noise.\n", noise);
+
+    instance->DestroySolver();
+    return 0;
+}
@@ -0,0 +1,222 @@
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS		1
+#define _CRT_NONSTDC_NO_WARNINGS	1
+#define _CRT_SECURE_NO_DEPRECATE	1
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "cktso.h"
+#include "bbd.h"
+#ifdef _MSC_VER
+#pragma comment(lib, "cktso.lib")
+#endif
+
+/*
+* SchurComplement: partial factorization for hierarchical/domain-decomposed solvers (row mode, real).
+* The nodes are split into interior nodes (I) and interface nodes (B). Only the interior block is factorized (with full pivoting,
+* by a solver instance), and the interface problem is returned to the caller:
+*     S = Abb - Abi*Aii^(-1)*Aib               (Schur complement, sparse CSR with a pattern fixed at analysis)
+*     g = bb - Abi*Aii^(-1)*bi                 (condensed right-hand-side)
+*     xi = Aii^(-1)*bi - Aii^(-1)*Aib*xb       (back-substitution once xb is known)
+* This is the one-block case of the bordered-block-diagonal split in bbd.h, with the interface as the border.
+*/
+class SchurComplement
+{
+public:
+    SchurComplement() : n(0), ni(0), nb(0), axv(NULL)
+    {
+    }
+
+    ~SchurComplement()
+    {
+        if (NULL != blk.inst) blk.inst->DestroySolver();
+    }
+
+    /*
+    * Analyze: splits the matrix and analyzes the interior block.
+    * @nif: # of interface nodes
+    * @iface: interface nodes (length nif). Their order defines the row/column order of S
+    * @threads: # of threads for the interior block
+    */
+    int Analyze(int n_, const int ap[], const int ai[], const double ax[], int nif, const int iface[], int threads)
+    {
+        n = n_;
+        nb = nif;
+        ni = n - nb;
+        axv = NULL;
+        part.assign(n, 0);
+        local.assign(n, -1);
+        for (int r = 0; r < nb; ++r)
+        {
+            if (iface[r] < 0 || iface[r] >= n || part[iface[r]] < 0) return -2;
+            part[iface[r]] = -1;
+            local[iface[r]] = r;
+        }
+        bnode.assign(iface, iface + nb);
+        int l = 0;
+        for (int i = 0; i < n; ++i)
+        {
+            if (part[i] >= 0) local[i] = l++;
+        }
+
+        //Split entries into Aii, Aib, Abi and Abb, then the pattern of S
+        blk.Split(ap, ai, part, 0, local, bnode);
+        s.Build(ap, ai, part, local, bnode, &blk, 1);
+
+        const int ret = blk.Create();
+        if (ret < 0) return ret;
+        return blk.Analyze(ax, threads);
+    }
+
+    /*
+    * Factorize: factorizes the interior block with pivoting and computes S.
+    */
+    int Factorize(const double ax[])
+    {
+        return Numeric(ax, false);
+    }
+
+    /*
+    * Refactorize: refactorizes the interior block without pivoting and computes S.
+    */
+    int Refactorize(const double ax[])
+    {
+        return Numeric(ax, true);
+    }
+
+    /*
+    * Schur: retrieves S in CSR format (nb rows), valid after Factorize/Refactorize.
+    */
+    void Schur(const int **sp_, const int **si_, const double **sx_) const
+    {
+        *sp_ = &s.sp[0];
+        *si_ = s.si.empty() ? NULL : &s.si[0];
+        *sx_ = s.sx.empty() ? NULL : &s.sx[0];
+    }
+
+    /*
+    * SchurDense: retrieves S as a dense row-major nb x nb matrix.
+    */
+    void SchurDense(double sd[]) const
+    {
+        memset(sd, 0, sizeof(double) * nb * nb);
+        for (int r = 0; r < nb; ++r)
+        {
+            for (int p = s.sp[r]; p < s.sp[r + 1]; ++p) sd[(size_t)r * nb + s.si[p]] = s.sx[p];
+        }
+    }
+
+    /*
+    * Condense: computes the condensed right-hand-side g (length nb) from the full right-hand-side b (length n).
+    * @return: -9 if Factorize/Refactorize has not succeeded
+    */
+    int Condense(const double b[], double g[])
+    {
+        if (NULL == axv) return -9;
+        const int ret = blk.Condense(b, false);
+        if (ret < 0) return ret;
+        for (int r = 0; r < nb; ++r) g[r] = b[bnode[r]];
+        for (size_t r = 0; r < blk.brows.size(); ++r) g[blk.brows[r]] -= blk.g[r];
+        return 0;
+    }
+
+    /*
+    * BackSubstitute: computes the full solution x (length n) from b and the interface solution xb (length nb).
+    * @return: -9 if Factorize/Refactorize has not succeeded
+    */
+    int BackSubstitute(const double b[], const double xb[], double x[])
+    {
+        if (NULL == axv) return -9;
+        const int ret = blk.Condense(b, false);
+        if (ret < 0) return ret;
+        for (int r = 0; r < nb; ++r) x[bnode[r]] = xb[r];
+        blk.BackSubstitute(xb, x);
+        return 0;
+    }
+
+private:
+    int Numeric(const double ax[], bool refactor)
+    {
+        axv = NULL;
+        const int ret = blk.Eliminate(ax, refactor);
+        if (ret < 0) return ret;
+        s.Assemble(ax, &blk, 1);
+        axv = ax;
+        return 0;
+    }
+
+    int n;
+    int ni; //# of interior nodes
+    int nb; //# of interface nodes
+    std::vector<int> part; //0 for an interior node, -1 for an interface node
+    std::vector<int> local; //local index of each node among interior or interface nodes
+    std::vector<int> bnode; //interface nodes
+    BBDBlock<int> blk; //the interior block
+    BBDSchur<int> s;
+    const double *axv; //values of the last factorized matrix, NULL before the first successful factorization
+};
+
+int main()
+{
+    //A subdomain: m x m grid of resistors with a few controlled sources, the last row of the grid is the interface
+    const int m = 40;
+    int n;
+    std::vector<int> ap, ai, part;
+    std::vector<double> ax;
+    BuildCircuit(1, m, 0, 0, n, ap, ai, ax, part);
+    std::vector<int> iface(m);
+    for (int c = 0; c < m; ++c) iface[c] = (m - 1) * m + c;
+    std::vector<double> b(n), x(n), g(m), xb(m);
+    for (int i = 0; i < n; ++i) b[i] = (double)rand() / RAND_MAX;
+
+    //Eliminate the interior
+    SchurComplement sc;
+    int ret = sc.Analyze(n, &ap[0], &ai[0], &ax[0], m, &iface[0], 1);
+    if (ret >= 0) printf("Condense before factorization returns %d.\n", sc.Condense(&b[0], &g[0]));
+    if (ret >= 0) ret = sc.Factorize(&ax[0]);
+    if (ret >= 0) ret = sc.Condense(&b[0], &g[0]);
+    if (ret < 0)
+    {
+        printf("Failed to compute Schur complement, return code = %d.\n", ret);
+        return ret;
+    }
+    const int *sp, *si;
+    const double *sx;
+    sc.Schur(&sp, &si, &sx);
+    printf("Interface nodes = %d, nnz(S) = %d.\n", m, sp[m]);
+
+    //The top-level solve, here done by another instance on the Schur complement
+    ICktSo top = NULL;
+    int *iparm;
+    const long long *oparm;
+    ret = CKTSO_CreateSolver(&top, &iparm, &oparm);
+    if (ret < 0)
+    {
+        printf("Failed to create solver instance, return code = %d.\n", ret);
+        return ret;
+    }
+    ret = top->Analyze(false, m, sp, si, sx, 1);
+    if (ret >= 0) ret = top->Factorize(sx, false);
+    if (ret >= 0) ret = top->Solve(&g[0], &xb[0], false, false);
+    if (ret >= 0) ret = sc.BackSubstitute(&b[0], &xb[0], &x[0]);
+    top->DestroySolver();
+    if (ret < 0)
+    {
+        printf("Failed to solve, return code = %d.\n", ret);
+        return ret;
+    }
+
+    //Calculate residual (L2 norm) of the full system
+    double err = 0.;
+    for (int r = 0; r < n; ++r)
+    {
+        double s = -b[r];
+        for (int p = ap[r]; p < ap[r + 1]; ++p) s += ax[p] * x[ai[p]];
+        err += s * s;
+    }
+    printf("Residual = %g.\n", sqrt(err));
+    return 0;
+}
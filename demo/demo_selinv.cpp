@@ -0,0 +1,498 @@
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS		1
+#define _CRT_NONSTDC_NO_WARNINGS	1
+#define _CRT_SECURE_NO_DEPRECATE	1
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <thread>
+#include "cktso.h"
+#include "mtxio.h"
+#include "parallel.h"
+#ifdef _MSC_VER
+#pragma comment(lib, "cktso.lib")
+#endif
+
+/*
+* SelectedInverse: selected entries of A^(-1) from the factors of ExtractFactors by the Takahashi (Erisman-Tinney) recursion
+* (real values).
+* With M = Dr*A(rperm,cperm)*Dc = L*U = L0*D*U (L0 unit lower, D = diag(L), U unit upper), Z = M^(-1) satisfies
+*     Z = D^(-1)*L0^(-1) + (I-U)*Z  and  Z = U^(-1)*D^(-1) + Z*(I-L0),
+* which give every entry of Z in the pattern of (L+U)^T (and the diagonal) from entries of the same pattern with larger indexes:
+*     Z(i,j) = -sum_k U(i,k)*Z(k,j) for i<j,  Z(i,j) = -sum_k Z(i,k)*L0(k,j) for i>j,  Z(i,i) = 1/D(i) - sum_k U(i,k)*Z(k,i).
+* The pattern is closed because L(j,i)!=0 and U(i,k)!=0 mean fill at (j,k), so nothing outside it is ever needed, and the cost is
+* about that of one factorization instead of n solves. Step m only depends on the steps of the rows of U(m,:) and L(:,m), so the
+* steps are grouped into levels of this dependency tree and each level is split among threads.
+* Entries of A^(-1) map to Z by A^(-1)(cperm[j],rperm[i]) = Dc(j)*Z(j,i)*Dr(i). Requested entries outside the pattern (e.g., some
+* diagonal entries of A^(-1) when pivoting made rperm differ from cperm) are computed by one Solve per distinct column.
+*/
+class SelectedInverse
+{
+public:
+    SelectedInverse() : inst(NULL), n(0), nthreads(1)
+    {
+    }
+
+    /*
+    * Compile: extracts the factors and builds the column structures and levels (call this routine after matrix has been
+    * factorized or refactorized).
+    * @iparm, oparm: parameters of inst_, iparm[7] must be the one used at analysis
+    * @return: <0 for error
+    */
+    int Compile(ICktSo inst_, const int iparm[], const long long oparm[], int n_)
+    {
+        inst = inst_;
+        n = n_;
+        const size_t nl = (size_t)oparm[5], nu = (size_t)oparm[6];
+        lp.resize((size_t)n + 1);
+        li.resize(nl + 1);
+        lx.resize(nl + 1);
+        up.resize((size_t)n + 1);
+        ui.resize(nu + 1);
+        ux.resize(nu + 1);
+        rperm.resize(n);
+        cperm.resize(n);
+        dr.resize(n);
+        dc.resize(n);
+        std::vector<double> rscale(n), cscale(n);
+        const int ret = inst->ExtractFactors(&lp[0], &li[0], &lx[0], &up[0], &ui[0], &ux[0], &rperm[0], &cperm[0], &rscale[0], &cscale[0]);
+        if (ret < 0) return ret;
+        for (int i = 0; i < n; ++i)
+        {
+            //Without scaling the factors are of the unscaled matrix, but the scaling vectors are still filled
+            dr[i] = (0 != iparm[7]) ? rscale[rperm[i]] : 1.;
+            dc[i] = (0 != iparm[7]) ? cscale[cperm[i]] : 1.;
+        }
+        zd.clear();
+
+        //Diagonal of L and the column structures of L (strictly lower) and U, with positions into lx/ux
+        diag.assign(n, 0.);
+        Transpose(lp, li, true, ltp, lti, ltv);
+        Transpose(up, ui, false, utp, uti, utv);
+        for (int i = 0; i < n; ++i)
+        {
+            for (size_t p = lp[i]; p < lp[i + 1]; ++p)
+            {
+                if (li[p] == i) diag[i] = lx[p];
+            }
+        }
+        posr.resize(n);
+        posc.resize(n);
+        for (int i = 0; i < n; ++i)
+        {
+            posr[rperm[i]] = i;
+            posc[cperm[i]] = i;
+        }
+
+        //Levels from the bottom: step m depends on the steps of U(m,:) and L(:,m)
+        std::vector<int> level(n);
+        int nlv = 0;
+        for (int m = n - 1; m >= 0; --m)
+        {
+            int lv = 0;
+            for (size_t p = up[m]; p < up[m + 1]; ++p)
+            {
+                if (level[ui[p]] + 1 > lv) lv = level[ui[p]] + 1;
+            }
+            for (size_t q = ltp[m]; q < ltp[m + 1]; ++q)
+            {
+                if (level[lti[q]] + 1 > lv) lv = level[lti[q]] + 1;
+            }
+            level[m] = lv;
+            if (lv + 1 > nlv) nlv = lv + 1;
+        }
+        lvp.assign((size_t)nlv + 1, 0);
+        for (int m = 0; m < n; ++m) ++lvp[level[m] + 1];
+        for (int l = 0; l < nlv; ++l) lvp[l + 1] += lvp[l];
+        lvi.resize(n);
+        std::vector<int> next(lvp.begin(), lvp.end() - 1);
+        for (int m = 0; m < n; ++m) lvi[next[level[m]]++] = m;
+        return ret;
+    }
+
+    /*
+    * Run: computes Z on the pattern.
+    * @threads: # of threads (0=all hardware threads)
+    */
+    void Run(int threads)
+    {
+        if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+        if (threads <= 0) threads = 1;
+        nthreads = threads;
+        zl.assign(lx.size(), 0.);
+        zu.assign(ux.size(), 0.);
+        zd.assign(n, 0.);
+        if (pool.Threads() != nthreads) pool.Start(nthreads);
+        barrier.Reset(nthreads);
+        pool.Run([this](int t) { Kernel(t); });
+    }
+
+    /*
+    * Entry: gets A^(-1)(r,c) if it is in the computed pattern.
+    * @return: 0 for success, 1 if the entry is outside the pattern, -2 if r or c is not in [0,n), -9 if Run has not been called
+    */
+    int Entry(int r, int c, double *v) const
+    {
+        if (r < 0 || r >= n || c < 0 || c >= n) return -2;
+        if (zd.size() != (size_t)n) return -9;
+        const int j = posc[r], i = posr[c];
+        double z;
+        if (!Z(j, i, &z)) return 1;
+        *v = dc[j] * z * dr[i];
+        return 0;
+    }
+
+    /*
+    * Select: gets requested entries of A^(-1), the ones outside the pattern by one Solve per distinct column.
+    * @return: # of fallback solves, or <0 for error (-2 if any row or column is not in [0,n), then no value is written)
+    */
+    int Select(int count, const int rows[], const int cols[], double values[])
+    {
+        for (int k = 0; k < count; ++k)
+        {
+            if (rows[k] < 0 || rows[k] >= n || cols[k] < 0 || cols[k] >= n) return -2;
+        }
+        std::vector<int> rest;
+        for (int k = 0; k < count; ++k)
+        {
+            const int ret = Entry(rows[k], cols[k], &values[k]);
+            if (ret < 0) return ret;
+            if (ret > 0) rest.push_back(k);
+        }
+        if (rest.empty()) return 0;
+        std::vector<int> first(n, -1), link(count, -1);
+        for (size_t k = 0; k < rest.size(); ++k)
+        {
+            link[rest[k]] = first[cols[rest[k]]];
+            first[cols[rest[k]]] = rest[k];
+        }
+        std::vector<double> e(n, 0.), x(n);
+        int solves = 0;
+        for (int c = 0; c < n; ++c)
+        {
+            if (first[c] < 0) continue;
+            e[c] = 1.;
+            const int ret = inst->Solve(&e[0], &x[0], false, false);
+            e[c] = 0.;
+            if (ret < 0) return ret;
+            ++solves;
+            for (int k = first[c]; k >= 0; k = link[k]) values[k] = x[rows[k]];
+        }
+        return solves;
+    }
+
+    int Levels() const
+    {
+        return (int)lvp.size() - 1;
+    }
+
+    /*
+    * PatternSize: # of entries of Z computed (nnz(L)+nnz(U)).
+    */
+    size_t PatternSize() const
+    {
+        return lp[n] + up[n];
+    }
+
+private:
+    static void Transpose(const std::vector<size_t> &p, const std::vector<int> &idx, bool lower, std::vector<size_t> &tp,
+        std::vector<int> &ti, std::vector<size_t> &tv)
+    {
+        const int n = (int)p.size() - 1;
+        tp.assign((size_t)n + 1, 0);
+        for (int i = 0; i < n; ++i)
+        {
+            for (size_t q = p[i]; q < p[i + 1]; ++q)
+            {
+                if (!lower || idx[q] != i) ++tp[(size_t)idx[q] + 1];
+            }
+        }
+        for (int i = 0; i < n; ++i) tp[i + 1] += tp[i];
+        ti.resize(tp[n]);
+        tv.resize(tp[n]);
+        std::vector<size_t> next(tp.begin(), tp.end() - 1);
+        for (int i = 0; i < n; ++i)
+        {
+            for (size_t q = p[i]; q < p[i + 1]; ++q)
+            {
+                if (lower && idx[q] == i) continue;
+                const size_t k = next[idx[q]]++;
+                ti[k] = i;
+                tv[k] = q;
+            }
+        }
+    }
+
+    //Z(i,j) in the pattern: Z(i,j) for i<j is kept at the position of L(j,i), for i>j at the position of U(j,i)
+    bool Z(int i, int j, double *z) const
+    {
+        if (i == j)
+        {
+            *z = zd[i];
+            return true;
+        }
+        if (i < j)
+        {
+            for (size_t p = lp[j]; p < lp[j + 1]; ++p)
+            {
+                if (li[p] == i)
+                {
+                    *z = zl[p];
+                    return true;
+                }
+            }
+            return false;
+        }
+        for (size_t p = up[j]; p < up[j + 1]; ++p)
+        {
+            if (ui[p] == i)
+            {
+                *z = zu[p];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Step(int m, std::vector<int> &pos, std::vector<double> &acc)
+    {
+        //Z(m,j) for L(j,m)!=0: -sum_k U(m,k)*Z(k,j), row k of Z is Z(k,k), Z(k,j>k) at L(:,k), Z(k,j<k) at U(:,k)
+        const size_t lb = ltp[m], le = ltp[m + 1];
+        for (size_t q = lb; q < le; ++q)
+        {
+            pos[lti[q]] = (int)(q - lb);
+            acc[q - lb] = 0.;
+        }
+        for (size_t p = up[m]; p < up[m + 1]; ++p)
+        {
+            const int k = ui[p];
+            const double u = ux[p];
+            if (pos[k] >= 0) acc[pos[k]] += u * zd[k];
+            for (size_t q = ltp[k]; q < ltp[k + 1]; ++q)
+            {
+                const int j = lti[q];
+                if (pos[j] >= 0) acc[pos[j]] += u * zl[ltv[q]];
+            }
+            for (size_t q = utp[k]; q < utp[k + 1]; ++q)
+            {
+                const int j = uti[q];
+                if (pos[j] >= 0) acc[pos[j]] += u * zu[utv[q]];
+            }
+        }
+        for (size_t q = lb; q < le; ++q)
+        {
+            zl[ltv[q]] = -acc[q - lb];
+            pos[lti[q]] = -1;
+        }
+
+        //Z(i,m) for U(m,i)!=0: -sum_k Z(i,k)*L0(k,m), column k of Z is Z(k,k), Z(i>k,k) at U(k,:), Z(i<k,k) at L(k,:)
+        const size_t ub = up[m], ue = up[m + 1];
+        for (size_t p = ub; p < ue; ++p)
+        {
+            pos[ui[p]] = (int)(p - ub);
+            acc[p - ub] = 0.;
+        }
+        const double dinv = 1. / diag[m];
+        for (size_t q = lb; q < le; ++q)
+        {
+            const int k = lti[q];
+            const double l0 = lx[ltv[q]] * dinv;
+            if (pos[k] >= 0) acc[pos[k]] += zd[k] * l0;
+            for (size_t p = up[k]; p < up[k + 1]; ++p)
+            {
+                const int i = ui[p];
+                if (pos[i] >= 0) acc[pos[i]] += zu[p] * l0;
+            }
+            for (size_t p = lp[k]; p < lp[k + 1]; ++p)
+            {
+                const int i = li[p];
+                if (i != k && pos[i] >= 0) acc[pos[i]] += zl[p] * l0;
+            }
+        }
+        double d = dinv;
+        for (size_t p = ub; p < ue; ++p)
+        {
+            zu[p] = -acc[p - ub];
+            pos[ui[p]] = -1;
+            d -= ux[p] * zu[p];
+        }
+        zd[m] = d;
+    }
+
+    void Kernel(int t)
+    {
+        std::vector<int> pos(n, -1);
+        std::vector<double> acc(n);
+        const int nlv = Levels();
+        for (int l = 0; l < nlv; ++l)
+        {
+            const int b = lvp[l], e = lvp[l + 1];
+            const int beg = b + (int)((long long)(e - b) * t / nthreads);
+            const int end = b + (int)((long long)(e - b) * (t + 1) / nthreads);
+            for (int k = beg; k < end; ++k) Step(lvi[k], pos, acc);
+            barrier.Wait();
+        }
+    }
+
+    ICktSo inst;
+    int n;
+    int nthreads;
+    std::vector<size_t> lp, up;
+    std::vector<int> li, ui;
+    std::vector<double> lx, ux, diag;
+    std::vector<size_t> ltp, utp; //column structures of L (strictly lower) and U
+    std::vector<int> lti, uti;
+    std::vector<size_t> ltv, utv; //positions into lx/ux
+    std::vector<int> rperm, cperm, posr, posc;
+    std::vector<double> dr, dc; //scaling in permuted order
+    std::vector<int> lvp, lvi; //steps grouped by level
+    std::vector<double> zl, zu, zd; //Z on the pattern of L^T, U^T and the diagonal
+    WorkerPool pool;
+    SpinBarrier barrier; //between levels
+};
+
+static long long Now()
+{
+    return (long long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: demo_selinv <mtx file> [# of threads] [scaling (iparm[7])]\n");
+        printf("Computes the diagonal of A^(-1) and a port block, and checks them against one solve per column when n <= 5000.\n");
+        printf("Example: demo_selinv add20.mtx 0 1\n");
+        return -1;
+    }
+    const int threads = argc > 2 ? atoi(argv[2]) : 0;
+
+    int n;
+    std::vector<int> ap, ai;
+    std::vector<double> ax;
+    bool is_complex;
+    int ret = LoadMatrix(argv[1], n, ap, ai, ax, is_complex, 0);
+    if (ret < 0)
+    {
+        printf("Cannot load matrix file \"%s\", return code = %d.\n", argv[1], ret);
+        return ret;
+    }
+    if (is_complex)
+    {
+        printf("Matrix \"%s\" is complex.\n", argv[1]);
+        return -2;
+    }
+
+    ICktSo instance = NULL;
+    int *iparm;
+    const long long *oparm;
+    ret = CKTSO_CreateSolver(&instance, &iparm, &oparm);
+    if (ret < 0)
+    {
+        printf("Failed to create solver instance, return code = %d.\n", ret);
+        return ret;
+    }
+    if (argc > 3) iparm[7] = atoi(argv[3]);
+    ret = instance->Analyze(false, n, ap.data(), ai.data(), ax.data(), threads);
+    if (ret >= 0) ret = instance->Factorize(ax.data(), false);
+    if (ret < 0)
+    {
+        printf("Failed to analyze or factorize matrix, return code = %d.\n", ret);
+        instance->DestroySolver();
+        return ret;
+    }
+
+    SelectedInverse selinv;
+    long long t0 = Now();
+    ret = selinv.Compile(instance, iparm, oparm, n);
+    if (ret < 0)
+    {
+        printf("Failed to extract factors, return code = %d.\n", ret);
+        instance->DestroySolver();
+        return ret;
+    }
+    const long long t1 = Now();
+    selinv.Run(threads);
+    const long long t2 = Now();
+
+    //Diagonal of A^(-1), e.g., for noise analysis
+    std::vector<int> rows(n);
+    for (int i = 0; i < n; ++i) rows[i] = i;
+    std::vector<double> dg(n);
+    const int solves = selinv.Select(n, &rows[0], &rows[0], &dg[0]);
+    const long long t3 = Now();
+    if (solves < 0)
+    {
+        printf("Failed to select the diagonal, return code = %d.\n", solves);
+        instance->DestroySolver();
+        return solves;
+    }
+
+    //Transfer block between a few ports (first and last nodes), mostly outside the pattern
+    const int np = n < 4 ? n : 4;
+    std::vector<int> br, bc;
+    for (int c = n - np; c < n; ++c)
+    {
+        for (int r = 0; r < np; ++r)
+        {
+            br.push_back(r);
+            bc.push_back(c);
+        }
+    }
+    std::vector<double> blk(br.size());
+    const int bsolves = selinv.Select((int)br.size(), &br[0], &bc[0], &blk[0]);
+    const long long t3b = Now();
+    printf("N = %d, pattern size = %lu, levels = %d.\n", n, (unsigned long)selinv.PatternSize(), selinv.Levels());
+    printf("Compile time = %lld us, selected inversion time = %lld us, diagonal extraction = %lld us with %d fallback solves.\n",
+        t1 - t0, t2 - t1, t3 - t2, solves);
+    printf("Port block %dx%d: %lld us with %d fallback solves.\n", np, np, t3b - t3, bsolves);
+    double v;
+    const int bad = n;
+    printf("Out-of-range requests: Entry returns %d, Select returns %d.\n", selinv.Entry(bad, 0, &v), selinv.Select(1, &bad, &rows[0], &v));
+
+    if (n <= 5000)
+    {
+        //Reference: one solve per column
+        std::vector<double> e(n, 0.), x(n);
+        double err = 0., nrm = 0., oerr = 0., onrm = 0., berr = 0., bnrm = 0.;
+        int checked = 0;
+        const long long t4 = Now();
+        for (int c = 0; c < n; ++c)
+        {
+            e[c] = 1.;
+            instance->Solve(&e[0], &x[0], false, false);
+            e[c] = 0.;
+            if (fabs(x[c] - dg[c]) > err) err = fabs(x[c] - dg[c]);
+            if (fabs(x[c]) > nrm) nrm = fabs(x[c]);
+            if (c >= n - np)
+            {
+                for (int r = 0; r < np; ++r)
+                {
+                    const double v = blk[(size_t)(c - n + np) * np + r];
+                    if (fabs(x[r] - v) > berr) berr = fabs(x[r] - v);
+                    if (fabs(x[r]) > bnrm) bnrm = fabs(x[r]);
+                }
+            }
+            //Off-diagonal entries in the pattern
+            for (int p = ap[c]; p < ap[c + 1]; ++p)
+            {
+                double v;
+                if (selinv.Entry(ai[p], c, &v) != 0) continue;
+                ++checked;
+                if (fabs(x[ai[p]] - v) > oerr) oerr = fabs(x[ai[p]] - v);
+                if (fabs(x[ai[p]]) > onrm) onrm = fabs(x[ai[p]]);
+            }
+        }
+        const long long t5 = Now();
+        printf("Reference by %d solves: %lld us. Max relative error of the diagonal = %g, of %d off-diagonal entries = %g.\n", n, t5 - t4,
+            nrm > 0. ? err / nrm : err, checked, onrm > 0. ? oerr / onrm : oerr);
+        printf("Max relative error of the port block = %g.\n", bnrm > 0. ? berr / bnrm : berr);
+    }
+
+    instance->DestroySolver();
+    return 0;
+}
@@ -0,0 +1,418 @@
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS		1
+#define _CRT_NONSTDC_NO_WARNINGS	1
+#define _CRT_SECURE_NO_DEPRECATE	1
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include "cktso.h"
+#ifdef _MSC_VER
+#pragma comment(lib, "cktso.lib")
+#endif
+
+/*
+* SmallMatrixSolver: fast path for tiny matrices (row mode, real), where per-call overhead of the library dominates.
+* Analyze and Factorize go to the library (ordering, scaling and pivoting are unchanged). For matrices up to SMALL_N rows whose
+* factorization takes at most SMALL_OPS multiply-adds, the pivot order of the last Factorize is compiled into flat lists of
+* value positions, and Refactorize/Solve run those lists on the caller's thread: no thread wake-up, no timer, no parameter checks
+* and no allocation per call. The library is already fast on sequential chains, so the first Factorize after Analyze times both
+* paths on the actual matrix and keeps the faster one. Larger matrices and anything that fails to compile use the library as is.
+*/
+class SmallMatrixSolver
+{
+public:
+    enum
+    {
+        SMALL_N = 500,
+        SMALL_OPS = 1 << 20,
+        CALIBRATE_REPS = 200 //a few microseconds each, so the min needs many samples
+    };
+
+    SmallMatrixSolver() : inst(NULL), iparm(NULL), oparm(NULL), n(0), fast(false), prefer(-1), failed(-1)
+    {
+    }
+
+    ~SmallMatrixSolver()
+    {
+        if (NULL != inst) inst->DestroySolver();
+    }
+
+    int Analyze(int n_, const int ap_[], const int ai_[], const double ax[], int threads)
+    {
+        if (NULL == inst)
+        {
+            const int ret = CKTSO_CreateSolver(&inst, &iparm, &oparm);
+            if (ret < 0) return ret;
+        }
+        n = n_;
+        fast = false;
+        prefer = -1;
+        ap.assign(ap_, ap_ + n + 1);
+        ai.assign(ai_, ai_ + ap[n]);
+        if (n <= SMALL_N)
+        {
+            threads = 1; //the library is only used for pivoting here, threads do not pay off
+            iparm[9] = 0;
+        }
+        return inst->Analyze(false, n, ap_, ai_, ax, threads);
+    }
+
+    /*
+    * Factorize: factorizes with pivoting by the library, and compiles the fast path for the new pivot order.
+    */
+    int Factorize(const double ax[])
+    {
+        int ret = inst->Factorize(ax, false);
+        if (ret < 0)
+        {
+            fast = false;
+            return ret;
+        }
+        fast = (0 != prefer) && (n <= SMALL_N) && Compile() >= 0;
+        if (fast && Numeric(ax) < 0) fast = false;
+        if (fast && prefer < 0)
+        {
+            prefer = (Calibrate(ax) ? 1 : 0);
+            fast = (1 == prefer);
+        }
+        return ret;
+    }
+
+    /*
+    * Refactorize: refactorizes with the pivot order of the last Factorize.
+    * @return: -6 if a zero or non-finite pivot is met (call Factorize), see FailedRow()
+    */
+    int Refactorize(const double ax[])
+    {
+        if (!fast) return inst->Refactorize(ax);
+        return Numeric(ax);
+    }
+
+    int Solve(const double b[], double x[])
+    {
+        if (!fast) return inst->Solve(b, x, false, false);
+        double *y = &v[0];
+        const double *f = &fx[0];
+        for (int i = 0; i < n; ++i) y[i] = b[rperm[i]];
+        for (int i = 0; i < n; ++i)
+        {
+            double s = y[i];
+            const int d = diag[i];
+            for (int p = fp[i]; p < d; ++p) s -= f[p] * y[fi[p]];
+            y[i] = s * invd[i];
+        }
+        for (int i = n - 1; i >= 0; --i)
+        {
+            double s = y[i];
+            for (int p = diag[i] + 1; p < fp[i + 1]; ++p) s -= f[p] * y[fi[p]];
+            y[i] = s;
+        }
+        for (int i = 0; i < n; ++i) x[cperm[i]] = y[i];
+        return 0;
+    }
+
+    bool Fast() const
+    {
+        return fast;
+    }
+
+    int FailedRow() const
+    {
+        return failed;
+    }
+
+    /*
+    * Ops: # of multiply-adds of the fast refactorization.
+    */
+    size_t Ops() const
+    {
+        return op.size() / 3;
+    }
+
+    ICktSo Instance() const
+    {
+        return inst;
+    }
+
+private:
+    /*
+    * Compile: builds the pattern of the factors (L with diagonal and U without diagonal, same convention as ExtractFactors) of
+    * A(rperm, cperm) by symbolic elimination, and the list of updates f[dst]-=f[a]*f[b] in execution order.
+    */
+    int Compile()
+    {
+        const size_t nl = (size_t)oparm[5];
+        const size_t nu = (size_t)oparm[6];
+        std::vector<size_t> lp(n + 1), up(n + 1);
+        std::vector<int> li(nl), ui(nu);
+        rperm.resize(n);
+        cperm.resize(n);
+        int ret = inst->ExtractFactors(&lp[0], nl ? &li[0] : NULL, NULL, &up[0], nu ? &ui[0] : NULL, NULL, &rperm[0], &cperm[0], NULL, NULL);
+        if (ret < 0) return ret;
+        std::vector<int> cinv(n);
+        for (int j = 0; j < n; ++j) cinv[cperm[j]] = j;
+
+        //Row-by-row symbolic elimination, rows are short so a dense marker is enough
+        std::vector<int> mark(n, -1), where(n, -1);
+        fp.assign(n + 1, 0);
+        fi.clear();
+        diag.resize(n);
+        op.clear();
+        amap.resize(ap[n]);
+        std::vector<int> row;
+        for (int i = 0; i < n; ++i)
+        {
+            const int r = rperm[i];
+            for (int p = ap[r]; p < ap[r + 1]; ++p) mark[cinv[ai[p]]] = i;
+            mark[i] = i;
+            for (int k = 0; k < i; ++k)
+            {
+                if (mark[k] != i) continue;
+                for (int q = diag[k] + 1; q < fp[k + 1]; ++q) mark[fi[q]] = i;
+            }
+            row.clear();
+            for (int j = 0; j < n; ++j)
+            {
+                if (mark[j] == i) row.push_back(j);
+            }
+            for (size_t e = 0; e < row.size(); ++e)
+            {
+                where[row[e]] = fp[i] + (int)e;
+                if (row[e] == i) diag[i] = where[row[e]];
+            }
+            fi.insert(fi.end(), row.begin(), row.end());
+            fp[i + 1] = (int)fi.size();
+            for (int p = ap[r]; p < ap[r + 1]; ++p) amap[p] = where[cinv[ai[p]]];
+            for (int p = fp[i]; p < diag[i]; ++p)
+            {
+                const int k = fi[p];
+                for (int q = diag[k] + 1; q < fp[k + 1]; ++q)
+                {
+                    op.push_back(where[fi[q]]);
+                    op.push_back(p);
+                    op.push_back(q);
+                }
+            }
+            opp.resize(i + 2);
+            opp[i + 1] = (int)op.size();
+            if (op.size() / 3 > SMALL_OPS) return -4;
+        }
+        opp[0] = 0;
+        fx.resize(fi.size());
+        v.resize(n);
+        invd.resize(n);
+
+        //Positions not covered by matrix entries (fill-ins) are cleared at every call, the others are overwritten
+        std::vector<bool> covered(fi.size(), false);
+        for (int p = 0; p < ap[n]; ++p)
+        {
+            if (covered[amap[p]]) return -2; //duplicated entries
+            covered[amap[p]] = true;
+        }
+        fill.clear();
+        for (size_t p = 0; p < fi.size(); ++p)
+        {
+            if (!covered[p]) fill.push_back((int)p);
+        }
+        return 0;
+    }
+
+    /*
+    * Calibrate: times Refactorize+Solve by the library and by the fast path (min of CALIBRATE_REPS calls each), returns whether the
+    * fast path is faster. The two paths are timed in turn in one loop, and the one timed first alternates, so that both see the same
+    * machine state.
+    */
+    bool Calibrate(const double ax[])
+    {
+        std::vector<double> b(n, 1.), x(n);
+        double tlib = HUGE_VAL, tfast = HUGE_VAL;
+        for (int r = 0; r < CALIBRATE_REPS * 2; ++r)
+        {
+            const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+            if (r % 2)
+            {
+                inst->Refactorize(ax);
+                inst->Solve(&b[0], &x[0], false, false);
+            }
+            else
+            {
+                Numeric(ax);
+                Solve(&b[0], &x[0]);
+            }
+            const double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            double &best = (r % 2) ? tlib : tfast;
+            if (t < best) best = t;
+        }
+        return tfast < tlib;
+    }
+
+    int Numeric(const double ax[])
+    {
+        double *f = &fx[0];
+        const int *o = op.empty() ? NULL : &op[0];
+        for (size_t e = 0; e < fill.size(); ++e) f[fill[e]] = 0.;
+        const int nnz = ap[n];
+        for (int p = 0; p < nnz; ++p) f[amap[p]] = ax[p];
+        for (int i = 0; i < n; ++i)
+        {
+            for (int q = opp[i]; q < opp[i + 1]; q += 3) f[o[q]] -= f[o[q + 1]] * f[o[q + 2]];
+            const double d = f[diag[i]];
+            if (d == 0. || d != d || d - d != 0.)
+            {
+                failed = rperm[i];
+                return -6;
+            }
+            const double inv = 1. / d;
+            invd[i] = inv;
+            for (int p = diag[i] + 1; p < fp[i + 1]; ++p) f[p] *= inv;
+        }
+        failed = -1;
+        return 0;
+    }
+
+    ICktSo inst;
+    int *iparm;
+    const long long *oparm;
+    int n;
+    bool fast; //fast path compiled for the current pivot order and selected
+    int prefer; //-1: not calibrated since Analyze, 0: library, 1: fast path
+    int failed; //original row of the failed pivot
+    std::vector<int> ap, ai;
+    std::vector<int> rperm, cperm;
+    std::vector<int> fp, fi, diag; //pattern of the factors of A(rperm, cperm), row by row, and diagonal positions
+    std::vector<int> amap; //position of each matrix entry in fx
+    std::vector<int> fill; //positions of fill-ins in fx
+    std::vector<int> op; //updates, (dst, a, b) triples
+    std::vector<int> opp; //updates of row i are op[opp[i]]~op[opp[i+1]-1]
+    std::vector<double> fx; //values of the factors
+    std::vector<double> invd; //reciprocals of L's diagonal
+    std::vector<double> v;
+};
+
+/*
+* Latency: times Refactorize+Solve per call (microseconds, averaged over reps) with the library (1 thread, timer off) and with
+* SmallMatrixSolver (whichever path it selected), and returns the largest difference between the two solutions.
+*/
+double Latency(int n, const int ap[], const int ai[], const double ax[], const double b[], int reps, double *lib_us, double *fast_us, const char **path)
+{
+    SmallMatrixSolver s;
+    ICktSo inst = NULL;
+    int *iparm;
+    const long long *oparm;
+    std::vector<double> x1(n), x2(n);
+    if (s.Analyze(n, ap, ai, ax, 1) < 0 || s.Factorize(ax) < 0) return -1.;
+    if (CKTSO_CreateSolver(&inst, &iparm, &oparm) < 0) return -1.;
+    iparm[0] = 0;
+    iparm[9] = 0;
+    int ret = inst->Analyze(false, n, ap, ai, ax, 1);
+    if (ret >= 0) ret = inst->Factorize(ax, false);
+    if (ret < 0)
+    {
+        inst->DestroySolver();
+        return -1.;
+    }
+
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < reps; ++r)
+    {
+        inst->Refactorize(ax);
+        inst->Solve(b, &x1[0], false, false);
+    }
+    std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+    for (int r = 0; r < reps; ++r)
+    {
+        s.Refactorize(ax);
+        s.Solve(b, &x2[0]);
+    }
+    std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+    *lib_us = std::chrono::duration<double, std::micro>(t1 - t0).count() / reps;
+    *fast_us = std::chrono::duration<double, std::micro>(t2 - t1).count() / reps;
+    inst->DestroySolver();
+    *path = s.Fast() ? "fast path" : "selected library path";
+
+    double diff = 0., xmax = 0.;
+    for (int i = 0; i < n; ++i)
+    {
+        if (fabs(x1[i] - x2[i]) > diff) diff = fabs(x1[i] - x2[i]);
+        if (fabs(x1[i]) > xmax) xmax = fabs(x1[i]);
+    }
+    return (xmax > 0.) ? diff / xmax : diff;
+}
+
+/*
+* Ladder: RC ladder subcircuit of m sections with a voltage source (MNA, zero diagonal on the branch row).
+*/
+void Ladder(int m, std::vector<int> &ap, std::vector<int> &ai, std::vector<double> &ax)
+{
+    const int n = m + 1;
+    ap.assign(1, 0);
+    ai.clear();
+    ax.clear();
+    for (int i = 0; i < m; ++i)
+    {
+        const double g = 1. + (double)rand() / RAND_MAX;
+        if (i > 0)
+        {
+            ai.push_back(i - 1);
+            ax.push_back(-g);
+        }
+        ai.push_back(i);
+        ax.push_back(2. * g + 1e-3);
+        if (i + 1 < m)
+        {
+            ai.push_back(i + 1);
+            ax.push_back(-g);
+        }
+        if (0 == i)
+        {
+            ai.push_back(n - 1);
+            ax.push_back(1.);
+        }
+        ap.push_back((int)ai.size());
+    }
+    ai.push_back(0);
+    ax.push_back(1.);
+    ap.push_back((int)ai.size());
+}
+
+int main()
+{
+    //The 6x6 matrix of demo.cpp
+    const double ax6[13] = { 1.1, -7.7, 13.13, 2.2, 9.9, 8.8, -3.3, -4.4, 11.11, 5.5, 10.1, 12.12, 6.6 };
+    const int ai6[13] = { 0, 3, 4, 1, 4, 1, 2, 3, 2, 4, 0, 3, 5 };
+    const int ap6[7] = { 0, 3, 5, 7, 8, 10, 13 };
+    const double b6[6] = { 35.95, 53.9, 7.7, -17.6, 60.83, 98.18 };
+    double lib_us, fast_us;
+    const char *path;
+    double diff = Latency(6, ap6, ai6, ax6, b6, 100000, &lib_us, &fast_us, &path);
+    if (diff < 0.)
+    {
+        printf("Failed to factorize matrix.\n");
+        return -1;
+    }
+    printf("n = 6: Refactorize+Solve = %.3f us (library), %.3f us (%s), relative difference = %g.\n", lib_us, fast_us, path, diff);
+
+    const int sizes[5] = { 10, 20, 50, 200, 499 };
+    for (int t = 0; t < 5; ++t)
+    {
+        std::vector<int> ap, ai;
+        std::vector<double> ax;
+        Ladder(sizes[t], ap, ai, ax);
+        const int n = sizes[t] + 1;
+        std::vector<double> b(n);
+        for (int i = 0; i < n; ++i) b[i] = (double)rand() / RAND_MAX;
+        diff = Latency(n, &ap[0], &ai[0], &ax[0], &b[0], 20000, &lib_us, &fast_us, &path);
+        if (diff < 0.)
+        {
+            printf("Failed to factorize matrix.\n");
+            return -1;
+        }
+        printf("n = %d: Refactorize+Solve = %.3f us (library), %.3f us (%s), relative difference = %g.\n", n, lib_us, fast_us, path, diff);
+    }
+    return 0;
+}
@@ -0,0 +1,445 @@
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS		1
+#define _CRT_NONSTDC_NO_WARNINGS	1
+#define _CRT_SECURE_NO_DEPRECATE	1
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include "cktso.h"
+#include "mtxio.h"
+#ifdef _MSC_VER
+#pragma comment(lib, "cktso.lib")
+#endif
+
+/*
+* SmartFactor: decides between Refactorize, fast Factorize and full Factorize for each new set of values.
+* Refactorize is tried first. Its pivots are accepted if every pivot passes the same threshold test as factorization (see
+* CheckedRefactorize) and the reciprocal pivot growth (smallest ratio of the largest entry of a row of the scaled and permuted matrix
+* to the largest entry of the same row of L) is not below the pivoting tolerance iparm[1]. Otherwise, the solver escalates to fast factorization (reuses pivots but checks them, falling back to partial pivoting from the first bad row)
+* and then to full factorization. When refactorization keeps failing, it is skipped until fast factorization reuses all pivots again.
+*/
+class SmartFactor
+{
+public:
+    enum Path
+    {
+        PATH_REFACTORIZE = 0,
+        PATH_FAST_FACTORIZE = 1,
+        PATH_FACTORIZE = 2
+    };
+
+    enum Reason
+    {
+        REASON_NONE = 0, //refactorization accepted
+        REASON_FIRST = 1, //no factors with pivoting yet
+        REASON_REFACTOR_FAILED = 2, //Refactorize returned an error (e.g., zero pivot)
+        REASON_PIVOT_GROWTH = 3, //reciprocal pivot growth after Refactorize is below the tolerance
+        REASON_UNSTABLE_HISTORY = 4, //refactorization was rejected in recent calls, so it was skipped
+        REASON_FAST_FAILED = 5, //fast factorization returned an error
+        REASON_PIVOT_CHECK = 6 //a pivot after Refactorize fails the threshold test, the row is retrieved by FailedRow
+    };
+
+    SmartFactor() : inst(NULL), iparm(NULL), oparm(NULL), n(0), ap(NULL), ai(NULL), lp(NULL), li(NULL), lx(NULL), ux(NULL), lcap(0), failed_row(-1),
+        factorized(false), rejects(0), path(PATH_FACTORIZE), reason(REASON_FIRST), rpg(0.), check_time(0)
+    {
+    }
+
+    ~SmartFactor()
+    {
+        delete []lp;
+        delete []li;
+        delete []lx;
+        delete []ux;
+    }
+
+    /*
+    * Initialize: binds an analyzed instance and the analyzed matrix pattern (row mode).
+    */
+    bool Initialize(ICktSo instance, const int iparm_[], const long long oparm_[], int n_, const int ap_[], const int ai_[])
+    {
+        inst = instance;
+        iparm = iparm_;
+        oparm = oparm_;
+        n = n_;
+        ap = ap_;
+        ai = ai_;
+        factorized = false;
+        rejects = 0;
+        lp = new size_t [(n + 1) * 2];
+        li = new int [n * 2];
+        if (NULL == lp || NULL == li) return false;
+        return true;
+    }
+
+    /*
+    * Factorize: factorizes the matrix through the cheapest path that gives acceptable pivots.
+    * @ax: double array of length ap[n], matrix values
+    * @return: the same as Factorize/Refactorize, or the error of the pivot check (e.g., -4 from ExtractFactors). The selected path and
+    *          the reason are retrieved by LastPath and LastReason
+    */
+    int Factorize(const double ax[])
+    {
+        int ret;
+        rpg = 0.;
+        failed_row = -1;
+        if (!factorized)
+        {
+            reason = REASON_FIRST;
+            return Full(ax);
+        }
+
+        if (rejects >= 2)
+        {
+            reason = REASON_UNSTABLE_HISTORY;
+        }
+        else
+        {
+            ret = CheckedRefactorize(ax, false);
+            if (ret >= 0)
+            {
+                if (rpg >= iparm[1] * 1e-6)
+                {
+                    path = PATH_REFACTORIZE;
+                    reason = REASON_NONE;
+                    rejects = 0;
+                    return 0;
+                }
+                reason = REASON_PIVOT_GROWTH;
+            }
+            else if (-6 == ret && failed_row >= 0) reason = REASON_PIVOT_CHECK;
+            else if (-4 == ret) return ret;
+            else reason = REASON_REFACTOR_FAILED;
+            ++rejects;
+        }
+
+        path = PATH_FAST_FACTORIZE;
+        ret = inst->Factorize(ax, true);
+        if (ret < 0)
+        {
+            if (-4 == ret) return ret;
+            reason = REASON_FAST_FAILED;
+            return Full(ax);
+        }
+        if (oparm[14] >= n) rejects = 0; //all pivots reused, so the pivoting order is stable again
+        int bad;
+        const int chk = Check(ax, &bad);
+        return (chk < 0) ? chk : ret;
+    }
+
+    /*
+    * CheckedRefactorize: refactorizes matrix without pivoting and then tests every pivot against the pivoting tolerance iparm[1].
+    * CKTSO selects pivots along rows and U has a unit diagonal, so row i of the reduced matrix is L(i,i)*[1, U(i,i+1:n)]. The pivot
+    * passes the threshold test of factorization, |L(i,i)| >= tol*max(|L(i,i)*U(i,j)|), exactly when max(|U(i,j)|) <= 1/tol. The test
+    * scans U once and stops at the first failing row.
+    * The check is not free: the factors are copied out by ExtractFactors (which dominates) and scanned together with the matrix for
+    * the pivot growth, which takes about half to two thirds of the refactorization time on small circuit matrices (LastCheckTime).
+    * @fallback: on failure, whether to call fast factorization, which reuses the pivots and re-pivots from the first bad row
+    * @return: the same as Refactorize, or -6 when a pivot fails (the row is retrieved by FailedRow) and fallback is false
+    */
+    int CheckedRefactorize(const double ax[], bool fallback)
+    {
+        failed_row = -1;
+        int ret = inst->Refactorize(ax);
+        if (ret < 0) return ret;
+        ret = Check(ax, &failed_row);
+        if (ret < 0) return ret;
+        if (failed_row < 0) return 0;
+        if (!fallback) return -6;
+        return inst->Factorize(ax, true);
+    }
+
+    /*
+    * FailedRow: original row index of the first pivot that failed the test in CheckedRefactorize (-1 if none).
+    */
+    int FailedRow() const
+    {
+        return failed_row;
+    }
+
+    Path LastPath() const
+    {
+        return path;
+    }
+
+    Reason LastReason() const
+    {
+        return reason;
+    }
+
+    /*
+    * LastCheckTime: time (in microsecond/us) of the last pivot check, on top of the factorization time in oparm[1].
+    */
+    long long LastCheckTime() const
+    {
+        return check_time;
+    }
+
+    /*
+    * LastPivotGrowth: reciprocal pivot growth of the current factors (1.0 is ideal).
+    */
+    double LastPivotGrowth() const
+    {
+        return rpg;
+    }
+
+private:
+    int Full(const double ax[])
+    {
+        path = PATH_FACTORIZE;
+        const int ret = inst->Factorize(ax, false);
+        if (ret < 0) return ret;
+        factorized = true;
+        rejects = 0;
+        int bad;
+        const int chk = Check(ax, &bad);
+        return (chk < 0) ? chk : ret;
+    }
+
+    /*
+    * Check: extracts the factors, finds the first row failing the pivot test, and calculates the reciprocal pivot growth.
+    * @bad: original row index of the first failing pivot (-1 if none)
+    */
+    int Check(const double ax[], int *bad)
+    {
+        const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        check_time = 0;
+        const size_t nnzl = (size_t)oparm[5] + oparm[6];
+        if (nnzl > lcap)
+        {
+            delete []li;
+            delete []lx;
+            delete []ux;
+            lcap = nnzl + nnzl / 2;
+            li = new int [lcap + n * 2];
+            lx = new double [lcap + n * 2];
+            ux = new double [lcap];
+            if (NULL == li || NULL == lx || NULL == ux)
+            {
+                lcap = 0;
+                return -4;
+            }
+        }
+        size_t *up = lp + n + 1;
+        int *ui = li + oparm[5];
+        int *rperm = li + nnzl;
+        int *cperm = rperm + n;
+        double *rscale = lx + nnzl;
+        double *cscale = rscale + n;
+        const int ret = inst->ExtractFactors(lp, li, lx, up, ui, ux, rperm, cperm, rscale, cscale);
+        if (ret < 0) return ret;
+
+        *bad = -1;
+        const double umax = 1e6 / iparm[1];
+        for (int i = 0; i < n && *bad < 0; ++i)
+        {
+            for (size_t p = up[i]; p < up[i + 1]; ++p)
+            {
+                if (!(fabs(ux[p]) <= umax))
+                {
+                    *bad = rperm[i];
+                    break;
+                }
+            }
+        }
+
+        const bool scaled = (iparm[7] != 0);
+        rpg = 1.;
+        for (int i = 0; i < n; ++i)
+        {
+            const int r = rperm[i];
+            double amax = 0.;
+            for (int p = ap[r]; p < ap[r + 1]; ++p)
+            {
+                const double a = scaled ? fabs(rscale[r] * ax[p] * cscale[ai[p]]) : fabs(ax[p]);
+                if (a > amax) amax = a;
+            }
+            double lmax = 0.;
+            for (size_t p = lp[i]; p < lp[i + 1]; ++p)
+            {
+                if (fabs(lx[p]) > lmax) lmax = fabs(lx[p]);
+            }
+            if (lmax > 0. && amax < rpg * lmax) rpg = amax / lmax;
+        }
+        check_time = (long long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+        return 0;
+    }
+
+    ICktSo inst;
+    const int *iparm;
+    const long long *oparm;
+    int n;
+    const int *ap;
+    const int *ai;
+    size_t *lp; //buffers for extracting factors, kept across calls
+    int *li;
+    double *lx;
+    double *ux;
+    size_t lcap;
+    int failed_row;
+    bool factorized;
+    int rejects; //# of consecutive rejected refactorizations
+    Path path;
+    Reason reason;
+    double rpg;
+    long long check_time;
+};
+
+/*
+* BackwardError: componentwise backward error max(|b-A*x|_i/(|A|*|x|+|b|)_i).
+*/
+double BackwardError(int n, const int ap[], const int ai[], const double ax[], const double x[], const double b[])
+{
+    double berr = 0.;
+    for (int i = 0; i < n; ++i)
+    {
+        double r = b[i], d = fabs(b[i]);
+        for (int p = ap[i]; p < ap[i + 1]; ++p)
+        {
+            r -= ax[p] * x[ai[p]];
+            d += fabs(ax[p] * x[ai[p]]);
+        }
+        if (d > 0. && fabs(r) > berr * d) berr = fabs(r) / d;
+    }
+    return berr;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        printf("Usage: demo_smartfactor <mtx file> <# of threads>\n");
+        printf("Example: demo_smartfactor add20.mtx 4\n");
+        return -1;
+    }
+
+    int n;
+    int *ap = NULL;
+    int *ai = NULL;
+    double *ax = NULL;
+    if (!ReadMtxFile(argv[1], n, ap, ai, ax))
+    {
+        delete []ap;
+        delete []ai;
+        delete []ax;
+        return -1;
+    }
+    const int nnz = ap[n];
+    double *cx = new double [nnz]; //original values
+    if (NULL == cx)
+    {
+        printf("Malloc for values failed.\n");
+        delete []ap;
+        delete []ai;
+        delete []ax;
+        return -1;
+    }
+    memcpy(cx, ax, sizeof(double) * nnz);
+
+    ICktSo instance = NULL;
+    int *iparm;
+    const long long *oparm;
+    int ret = CKTSO_CreateSolver(&instance, &iparm, &oparm);
+    if (ret < 0)
+    {
+        printf("Failed to create solver instance, return code = %d.\n", ret);
+        delete []ap;
+        delete []ai;
+        delete []ax;
+        delete []cx;
+        return ret;
+    }
+    iparm[0] = 1;
+
+    ret = instance->Analyze(false, n, ap, ai, ax, atoi(argv[2]));
+    if (ret < 0)
+    {
+        printf("Failed to analyze matrix, return code = %d.\n", ret);
+        delete []ap;
+        delete []ai;
+        delete []ax;
+        delete []cx;
+        instance->DestroySolver();
+        return ret;
+    }
+
+    SmartFactor sf;
+    if (!sf.Initialize(instance, iparm, oparm, n, ap, ai))
+    {
+        printf("Failed to initialize smart factorization.\n");
+        delete []ap;
+        delete []ai;
+        delete []ax;
+        delete []cx;
+        instance->DestroySolver();
+        return -4;
+    }
+
+    //Simulate Newton-Raphson iterations: values change slightly, then wildly for a few iterations, then slightly again
+    static const char *paths[] = { "refactorization", "fast factorization", "factorization" };
+    static const char *reasons[] = { "pivots accepted", "first factorization", "refactorization failed", "pivot growth too large",
+        "refactorization rejected recently", "fast factorization failed", "pivot check failed" };
+    for (int j = 0; j < 15; ++j)
+    {
+        const double spread = (j >= 5 && j < 10) ? 1e14 : 1.1;
+        for (int p = 0; p < nnz; ++p)
+        {
+            ax[p] = cx[p] * pow(spread, (double)rand() / RAND_MAX - .5);
+        }
+        ret = sf.Factorize(ax);
+        if (ret < 0)
+        {
+            printf("Failed to factorize matrix, return code = %d.\n", ret);
+            break;
+        }
+        printf("Iteration [%d]: %s (%s", j, paths[sf.LastPath()], reasons[sf.LastReason()]);
+        if (SmartFactor::REASON_PIVOT_CHECK == sf.LastReason()) printf(" at row %d", sf.FailedRow());
+        printf("), time = %lld us, pivot check = %lld us, reciprocal pivot growth = %g.\n", oparm[1], sf.LastCheckTime(), sf.LastPivotGrowth());
+    }
+
+    //CheckedRefactorize with fallback: good pivots from the original values, then values changing wildly until a pivot fails
+    double *b = new double [n + n];
+    if (NULL == b)
+    {
+        printf("Malloc for right-hand-side failed.\n");
+        delete []ap;
+        delete []ai;
+        delete []ax;
+        delete []cx;
+        instance->DestroySolver();
+        return -4;
+    }
+    double *x = b + n;
+    for (int i = 0; i < n; ++i) b[i] = (double)rand() / RAND_MAX * 100.;
+    ret = sf.Factorize(cx);
+    for (int k = 0; k < 10 && ret >= 0; ++k)
+    {
+        for (int p = 0; p < nnz; ++p) ax[p] = cx[p] * pow(1e14, (double)rand() / RAND_MAX - .5);
+        ret = sf.CheckedRefactorize(ax, true);
+        if (ret < 0 || sf.FailedRow() >= 0) break;
+    }
+    if (ret >= 0) ret = instance->Solve(b, x, false, false);
+    if (ret < 0) printf("Checked refactorization with fallback failed, return code = %d.\n", ret);
+    else if (sf.FailedRow() < 0) printf("Checked refactorization with fallback: no pivot failed in 10 tries.\n");
+    else
+    {
+        printf("Checked refactorization with fallback: pivot failed at row %d, fast factorization reused %lld of %d pivots, "
+            "time = %lld us, pivot check = %lld us, backward error = %g.\n", sf.FailedRow(), oparm[14], n, oparm[1], sf.LastCheckTime(),
+            BackwardError(n, ap, ai, ax, x, b));
+
+        //Reference: full factorization of the same values, the fallback should be as accurate
+        ret = instance->Factorize(ax, false);
+        if (ret >= 0) ret = instance->Solve(b, x, false, false);
+        if (ret >= 0) printf("Full factorization of the same values: backward error = %g.\n", BackwardError(n, ap, ai, ax, x, b));
+    }
+    delete []b;
+
+    delete []ap;
+    delete []ai;
+    delete []ax;
+    delete []cx;
+    instance->DestroySolver();
+    return 0;
+}
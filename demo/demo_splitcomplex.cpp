@@ -0,0 +1,114 @@
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS		1
+#define _CRT_NONSTDC_NO_WARNINGS	1
+#define _CRT_SECURE_NO_DEPRECATE	1
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "cktso.h"
+#include "splitcomplex.h"
+#ifdef _MSC_VER
+#pragma comment(lib, "cktso.lib")
+#endif
+
+int main()
+{
+    int ret;
+    int n = 6;
+    //The same matrix as demo_complex.cpp, with real and imaginary parts stored separately
+    double axr[13] = { 1., -7., 13., 2., 9., 8., -3., -4., 11., 5., 10., 12., 6. };
+    double axi[13] = { 1.1, -7.7, 13.13, 2.2, 9.9, 8.8, -3.3, -4.4, 11.11, 5.5, 10.10, 12.12, 6.6 };
+    int ai[13] = { 0, 3, 4, 1, 4, 1, 2, 3, 2, 4, 0, 3, 5 };
+    int ap[7] = { 0, 3, 5, 7, 8, 10, 13 };
+    double br[6] = { -2.9, -20.8, -6.4, 7.2, -21.66, -36.36 };
+    double bi[6] = { 141.37, 193.7, 23.9, -62.8, 221.05, 355.54 };
+    double xr[6], xi[6];
+
+    //Create solver instance
+    ICktSo instance = nullptr;
+    int *iparm;
+    const long long *oparm;
+    ret = CKTSO_CreateSolver(&instance, &iparm, &oparm);
+    if (ret < 0)
+    {
+        printf("Failed to create solver instance, return code = %d.\n", ret);
+        return ret;
+    }
+    iparm[0] = 1; //enable high-precision timer
+
+    //Wrap the instance to use split real/imaginary arrays
+    SplitComplexSolver<ICktSo, int> solver(instance);
+
+    //Analyze matrix, with buffers for up to 2 right-hand-side vectors at once
+    ret = solver.Analyze(n, ap, ai, axr, axi, 0, 2);
+    if (ret < 0)
+    {
+        printf("Failed to analyze matrix, return code = %d.\n", ret);
+        instance->DestroySolver();
+        return ret;
+    }
+
+    //Factorize matrix
+    ret = solver.Factorize(axr, axi, true);
+    if (ret < 0)
+    {
+        printf("Failed to factorize matrix, return code = %d.\n", ret);
+        instance->DestroySolver();
+        return ret;
+    }
+
+    //Solve linear system
+    ret = solver.Solve(br, bi, xr, xi, false, false);
+    if (ret < 0)
+    {
+        printf("Failed to solve linear system, return code = %d.\n", ret);
+        instance->DestroySolver();
+        return ret;
+    }
+    for (int i = 0; i < n; ++i)
+    {
+        printf("x[%d] = (%g,%g)\n", i, xr[i], xi[i]);
+    }
+
+    //Calculate residual (L2 norm). This is just for checking the result
+    double err = 0.;
+    for (int r = 0; r < n; ++r)
+    {
+        double sr = -br[r], si = -bi[r];
+        for (int c = ap[r]; c < ap[r + 1]; ++c)
+        {
+            const int j = ai[c];
+            sr += axr[c] * xr[j] - axi[c] * xi[j];
+            si += axr[c] * xi[j] + axi[c] * xr[j];
+        }
+        err += sr * sr + si * si;
+    }
+    printf("Residual = %g.\n", sqrt(err));
+
+    //Refactorize with new values and solve two right-hand-side vectors at once
+    for (int i = 0; i < 13; ++i) axi[i] *= 2.;
+    double br2[12], bi2[12], xr2[12], xi2[12];
+    for (int i = 0; i < n; ++i)
+    {
+        br2[i] = br[i];
+        bi2[i] = bi[i];
+        br2[n + i] = bi[i];
+        bi2[n + i] = -br[i];
+    }
+    ret = solver.Refactorize(axr, axi);
+    if (ret >= 0) ret = solver.SolveMV(2, br2, bi2, 0, xr2, xi2, 0, false);
+    if (ret < 0)
+    {
+        printf("Failed to refactorize or solve, return code = %d.\n", ret);
+        instance->DestroySolver();
+        return ret;
+    }
+    for (int i = 0; i < n; ++i)
+    {
+        printf("x1[%d] = (%g,%g), x2[%d] = (%g,%g)\n", i, xr2[i], xi2[i], i, xr2[n + i], xi2[n + i]);
+    }
+
+    instance->DestroySolver();
+    return 0;
+}
@@ -0,0 +1,87 @@
+/*
+* Factors of ICktSo::ExtractFactors prepared for client-side triangular solves (real values, row mode), shared by FusedSolver
+* (demo_fusedsolve.cpp) and HybridSolver (hybridsolve.h).
+*/
+
+#ifndef __CKTSO_FACTORS__
+#define __CKTSO_FACTORS__
+#include <stddef.h>
+#include <vector>
+#include "cktso.h"
+
+/*
+* FoldedFactors: with L*U = Dr*A*Dc permuted by rperm and cperm, the scaling is folded into the factors as
+*     L' = Dr'^-1*L*Dc'^-1 (strictly lower part lp/li/lx and inverse diagonal invd),  U' = Dc'*U*Dc'^-1 (up/ui/ux, unit diagonal)
+* where Dr' and Dc' are the scaling vectors in permuted order, so that L'*U' = A(rperm,cperm) and solves do no scaling at all:
+*     forward:  w[i] = (b[rperm[i]] - sum L'(i,k)*w[k]) * invd[i]
+*     backward: w[i] -= sum U'(i,k)*w[k],  x[cperm[i]] = w[i]
+*/
+struct FoldedFactors
+{
+    int n;
+    std::vector<size_t> lp, up;
+    std::vector<int> li, ui;
+    std::vector<double> lx, ux, invd;
+    std::vector<int> rperm, cperm;
+
+    FoldedFactors() : n(0)
+    {
+    }
+
+    /*
+    * Build: extracts and folds the factors (call this routine after matrix has been factorized or refactorized).
+    * @iparm, oparm: parameters of inst, iparm[7] must be the one used at analysis
+    * @return: <0 for error
+    */
+    int Build(ICktSo inst, const int iparm[], const long long oparm[], int n_)
+    {
+        n = n_;
+        const size_t nl = (size_t)oparm[5], nu = (size_t)oparm[6];
+        std::vector<size_t> lp0((size_t)n + 1);
+        std::vector<int> li0(nl + 1);
+        std::vector<double> lx0(nl + 1), rscale(n), cscale(n);
+        up.resize((size_t)n + 1);
+        ui.resize(nu + 1);
+        ux.resize(nu + 1);
+        rperm.resize(n);
+        cperm.resize(n);
+        const int ret = inst->ExtractFactors(&lp0[0], &li0[0], &lx0[0], &up[0], &ui[0], &ux[0], &rperm[0], &cperm[0], &rscale[0], &cscale[0]);
+        if (ret < 0) return ret;
+        if (0 == iparm[7])
+        {
+            //Without scaling the factors are of the unscaled matrix, but the scaling vectors are still filled
+            rscale.assign(n, 1.);
+            cscale.assign(n, 1.);
+        }
+
+        std::vector<double> dc(n);
+        for (int i = 0; i < n; ++i) dc[i] = cscale[cperm[i]];
+        lp.assign((size_t)n + 1, 0);
+        li.resize(nl);
+        lx.resize(nl);
+        invd.assign(n, 0.);
+        size_t q = 0;
+        for (int i = 0; i < n; ++i)
+        {
+            const double s = 1. / rscale[rperm[i]];
+            for (size_t p = lp0[i]; p < lp0[i + 1]; ++p)
+            {
+                if (li0[p] == i) invd[i] = dc[i] / (lx0[p] * s);
+                else
+                {
+                    li[q] = li0[p];
+                    lx[q] = lx0[p] * s / dc[li0[p]];
+                    ++q;
+                }
+            }
+            lp[i + 1] = q;
+        }
+        for (int i = 0; i < n; ++i)
+        {
+            for (size_t p = up[i]; p < up[i + 1]; ++p) ux[p] *= dc[i] / dc[ui[p]];
+        }
+        return ret;
+    }
+};
+
+#endif
@@ -0,0 +1,302 @@
+/*
+* Hybrid level-scheduled triangular solve on the factors of ICktSo::ExtractFactors (real values, row mode).
+* The rows of L (forward sweep) and U (backward sweep) are grouped into dependency levels. Wide levels are split among threads,
+* and runs of narrow levels (chains of the elimination tree) are executed by one thread in level order, so threads only sync at
+* the boundaries of the wide levels. The schedule is computed once per factorization by Compile.
+* Calibrate times the hybrid schedule against the sequential and parallel Solve of the library and picks the fastest, so the chosen
+* path never loses to the sequential solve on the calibrated matrix. Compile keeps the path chosen by the last Calibrate (sequential
+* before the first one), as factorizations of one circuit keep the pattern, and keeps the worker threads unless their number changes.
+* Statistics of the schedule and the choice are exposed for reports.
+* The permutation and scaling are folded into the factors (FoldedFactors of factors.h) and the sweeps, as in demo_fusedsolve.cpp.
+* On few cores the hybrid path usually loses to the sequential solve, and calibration costs 60 solves, so it is demonstrated by
+* demo_hybridsolve.cpp rather than run by every benchmark.
+*/
+
+#ifndef __CKTSO_HYBRIDSOLVE__
+#define __CKTSO_HYBRIDSOLVE__
+#include <stddef.h>
+#include <limits.h>
+#include <chrono>
+#include <vector>
+#include <thread>
+#include "cktso.h"
+#include "factors.h"
+#include "parallel.h"
+
+class HybridSolver
+{
+public:
+    enum
+    {
+        PATH_SEQUENTIAL = 0, //library Solve, force_seq=true
+        PATH_PARALLEL, //library Solve, force_seq=false
+        PATH_HYBRID //level schedule of this class
+    };
+
+    HybridSolver() : inst(NULL), n(0), nthreads(1), path(PATH_SEQUENTIAL), b(NULL), x(NULL)
+    {
+        for (int k = 0; k < 3; ++k) time[k] = -1;
+    }
+
+    /*
+    * Compile: extracts the factors and builds the schedule (call this routine after matrix has been factorized or refactorized).
+    * @iparm, oparm: parameters of inst_, iparm[7] must be the one used at analysis
+    * @threads: # of threads (0=all hardware threads)
+    * @min_width: min # of rows of a level to be split among threads, <=0 for 32 rows per thread
+    * @return: <0 for error
+    */
+    int Compile(ICktSo inst_, const int iparm[], const long long oparm[], int n_, int threads, int min_width)
+    {
+        inst = inst_;
+        n = n_;
+        const int ret = f.Build(inst, iparm, oparm, n);
+        if (ret < 0) return ret;
+        work.resize(n);
+
+        if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+        if (threads <= 0) threads = 1;
+        nthreads = threads;
+        if (min_width <= 0) min_width = 32 * nthreads;
+
+        //Levels: forward from the top of L, backward from the bottom of U
+        std::vector<int> level(n);
+        for (int i = 0; i < n; ++i)
+        {
+            int lv = 0;
+            for (size_t p = f.lp[i]; p < f.lp[i + 1]; ++p)
+            {
+                if (level[f.li[p]] + 1 > lv) lv = level[f.li[p]] + 1;
+            }
+            level[i] = lv;
+        }
+        Schedule(level, min_width, false, fwd);
+        for (int i = n - 1; i >= 0; --i)
+        {
+            int lv = 0;
+            for (size_t p = f.up[i]; p < f.up[i + 1]; ++p)
+            {
+                if (level[f.ui[p]] + 1 > lv) lv = level[f.ui[p]] + 1;
+            }
+            level[i] = lv;
+        }
+        Schedule(level, min_width, true, bwd);
+
+        barrier.Reset(nthreads);
+        if (pool.Threads() != nthreads) pool.Start(nthreads);
+        return ret;
+    }
+
+    /*
+    * Calibrate: times the three paths with the given right-hand-side and picks the fastest one (min of reps solves each).
+    * @return: <0 for error
+    */
+    int Calibrate(const double rhs[], int reps)
+    {
+        std::vector<double> sol(n);
+        for (int k = 0; k < 3; ++k)
+        {
+            path = k;
+            long long best = LLONG_MAX;
+            for (int r = 0; r < reps; ++r)
+            {
+                const auto t0 = std::chrono::steady_clock::now();
+                const int ret = Solve(rhs, &sol[0]);
+                const long long ns = (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+                if (ret < 0) return ret;
+                if (ns < best) best = ns;
+            }
+            time[k] = best;
+        }
+        path = PATH_SEQUENTIAL;
+        for (int k = 1; k < 3; ++k)
+        {
+            if (time[k] < time[path]) path = k;
+        }
+        return 0;
+    }
+
+    /*
+    * Solve: solves A*x=b by the chosen path, x can be the same address as b.
+    */
+    int Solve(const double b_[], double x_[])
+    {
+        if (PATH_SEQUENTIAL == path) return inst->Solve(b_, x_, true, false);
+        if (PATH_PARALLEL == path) return inst->Solve(b_, x_, false, false);
+        b = b_;
+        x = x_;
+        Run();
+        return 0;
+    }
+
+    int Path() const
+    {
+        return path;
+    }
+
+    /*
+    * SetPath: forces a path until the next Calibrate, e.g. to check the hybrid path whichever is faster.
+    */
+    void SetPath(int p)
+    {
+        if (p >= 0 && p < 3) path = p;
+    }
+
+    static const char *PathName(int p)
+    {
+        static const char *const names[3] = { "sequential", "parallel", "hybrid" };
+        return (p >= 0 && p < 3) ? names[p] : "unknown";
+    }
+
+    /*
+    * Time: min time (ns) of a path measured by Calibrate, -1 if not calibrated.
+    */
+    long long Time(int p) const
+    {
+        return (p >= 0 && p < 3) ? time[p] : -1;
+    }
+
+    /*
+    * Statistics of the schedule of both sweeps: # of levels, # of wide (parallel) levels, # of rows in wide levels, and # of syncs.
+    */
+    void Statistics(int *levels, int *wide_levels, int *wide_rows, int *syncs) const
+    {
+        if (levels != NULL) *levels = fwd.levels + bwd.levels;
+        if (wide_levels != NULL) *wide_levels = fwd.wide_levels + bwd.wide_levels;
+        if (wide_rows != NULL) *wide_rows = fwd.wide_rows + bwd.wide_rows;
+        if (syncs != NULL) *syncs = (nthreads > 1) ? (int)(fwd.wide.size() + bwd.wide.size()) - 1 : 0;
+    }
+
+    int Threads() const
+    {
+        return nthreads;
+    }
+
+private:
+    struct Sweep
+    {
+        std::vector<int> order; //rows sorted by level
+        std::vector<int> stage; //stage boundaries in order, stage k is order[stage[k]]~order[stage[k+1]-1]
+        std::vector<char> wide; //whether stage k is split among threads
+        int levels, wide_levels, wide_rows;
+    };
+
+    //Sorts rows by level and merges runs of narrow levels into sequential stages
+    void Schedule(const std::vector<int> &level, int min_width, bool reverse, Sweep &sw)
+    {
+        int nlv = 0;
+        for (int i = 0; i < n; ++i)
+        {
+            if (level[i] + 1 > nlv) nlv = level[i] + 1;
+        }
+        std::vector<int> cnt((size_t)nlv + 1, 0);
+        for (int i = 0; i < n; ++i) ++cnt[level[i] + 1];
+        for (int l = 0; l < nlv; ++l) cnt[l + 1] += cnt[l];
+        sw.order.resize(n);
+        std::vector<int> next(cnt.begin(), cnt.end() - 1);
+        for (int k = 0; k < n; ++k)
+        {
+            const int i = reverse ? n - 1 - k : k; //within a level, keep the natural sweep order for locality
+            sw.order[next[level[i]]++] = i;
+        }
+        sw.stage.assign(1, 0);
+        sw.wide.clear();
+        sw.levels = nlv;
+        sw.wide_levels = 0;
+        sw.wide_rows = 0;
+        for (int l = 0; l < nlv; ++l)
+        {
+            const int width = cnt[l + 1] - cnt[l];
+            const bool w = nthreads > 1 && width >= min_width;
+            if (w)
+            {
+                ++sw.wide_levels;
+                sw.wide_rows += width;
+            }
+            if (!w && !sw.wide.empty() && !sw.wide.back()) sw.stage.back() = cnt[l + 1]; //extend the sequential stage
+            else
+            {
+                sw.stage.push_back(cnt[l + 1]);
+                sw.wide.push_back(w);
+            }
+        }
+    }
+
+    void Forward(int k, int t)
+    {
+        const int *ord = &fwd.order[0];
+        const int s0 = fwd.stage[k], s1 = fwd.stage[k + 1];
+        int beg = s0, end = s1;
+        if (fwd.wide[k])
+        {
+            beg = s0 + (int)((long long)(s1 - s0) * t / nthreads);
+            end = s0 + (int)((long long)(s1 - s0) * (t + 1) / nthreads);
+        }
+        else if (t != 0) return;
+        double *w = &work[0];
+        for (int r = beg; r < end; ++r)
+        {
+            const int i = ord[r];
+            double s = b[f.rperm[i]];
+            for (size_t p = f.lp[i]; p < f.lp[i + 1]; ++p) s -= f.lx[p] * w[f.li[p]];
+            w[i] = s * f.invd[i];
+        }
+    }
+
+    void Backward(int k, int t)
+    {
+        const int *ord = &bwd.order[0];
+        const int s0 = bwd.stage[k], s1 = bwd.stage[k + 1];
+        int beg = s0, end = s1;
+        if (bwd.wide[k])
+        {
+            beg = s0 + (int)((long long)(s1 - s0) * t / nthreads);
+            end = s0 + (int)((long long)(s1 - s0) * (t + 1) / nthreads);
+        }
+        else if (t != 0) return;
+        double *w = &work[0];
+        for (int r = beg; r < end; ++r)
+        {
+            const int i = ord[r];
+            double s = w[i];
+            for (size_t p = f.up[i]; p < f.up[i + 1]; ++p) s -= f.ux[p] * w[f.ui[p]];
+            w[i] = s;
+        }
+    }
+
+    void Kernel(int t)
+    {
+        const int nf = (int)fwd.wide.size(), nb = (int)bwd.wide.size();
+        for (int k = 0; k < nf; ++k)
+        {
+            Forward(k, t);
+            barrier.Wait();
+        }
+        for (int k = 0; k < nb; ++k)
+        {
+            Backward(k, t);
+            if (k + 1 < nb) barrier.Wait();
+        }
+    }
+
+    void Run()
+    {
+        pool.Run([this](int t) { Kernel(t); });
+        //The scatter is done after the backward sweep, so x can share the address of b
+        for (int i = 0; i < n; ++i) x[f.cperm[i]] = work[i];
+    }
+
+    ICktSo inst;
+    int n;
+    int nthreads;
+    int path;
+    long long time[3];
+    FoldedFactors f;
+    std::vector<double> work;
+    Sweep fwd, bwd;
+    const double *b;
+    double *x;
+    WorkerPool pool;
+    SpinBarrier barrier;
+};
+
+#endif
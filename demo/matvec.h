@@ -0,0 +1,238 @@
+/*
+* Parallel sparse matrix-vector product and residual on the same CSR/CSC arrays passed to CKTSO(_L)_Analyze.
+* Works for both ICktSo (INT=int) and ICktSo_L (INT=long long), real and complex (interleaved) values, row and column modes.
+* The pattern is fixed after analysis, so rows are partitioned among threads once by the number of nonzeros; later calls only
+* gather values. Each row is accumulated in a fixed order by a single thread, and the residual norm is summed over fixed blocks of
+* rows (thread partitions are aligned to the blocks) and then over the blocks in order, so results do not depend on the thread number.
+*/
+
+#ifndef __CKTSO_MATVEC__
+#define __CKTSO_MATVEC__
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <thread>
+#include "parallel.h"
+
+template <typename INT>
+class ParallelMatVec
+{
+public:
+    enum
+    {
+        BLOCK = 64 //rows per partial sum of the residual norm
+    };
+
+    ParallelMatVec() : n(0), ap(NULL), ai(NULL), nthreads(1)
+    {
+    }
+
+    /*
+    * Initialize: binds the matrix pattern and starts the worker threads.
+    * @n: matrix dimension
+    * @ap: integer array of length n+1, matrix row (row mode) or column (column mode) pointers
+    * @ai: integer array of length ap[n], matrix column (row mode) or row (column mode) indexes
+    * @row0_column1: row or column mode, the same as CKTSO(_L)_Solve
+    * @threads: # of threads (0=all hardware threads)
+    */
+    bool Initialize(INT n_, const INT ap_[], const INT ai_[], bool row0_column1, int threads)
+    {
+        pool.Stop();
+        n = n_;
+        const size_t nnz = (size_t)ap_[n];
+        if (row0_column1)
+        {
+            //Build the transposed pattern once, keeping positions into ax so values can be gathered at every call
+            TransposePattern(n, ap_, ai_, tp, ti, tv);
+            ap = NULL;
+            ai = NULL;
+        }
+        else
+        {
+            tp.clear();
+            ti.clear();
+            tv.clear();
+            ap = ap_;
+            ai = ai_;
+        }
+
+        if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+        if (threads <= 0) threads = 1;
+        if ((INT)threads > n) threads = (n > 0) ? (int)n : 1;
+        nthreads = threads;
+
+        //Partition rows so that each thread gets about the same number of nonzeros, at block boundaries
+        beg.assign((size_t)nthreads + 1, 0);
+        INT r = 0;
+        for (int t = 1; t < nthreads; ++t)
+        {
+            const size_t target = nnz * t / nthreads;
+            while (r < n && RowEnd(r) <= target) ++r;
+            INT rb = (r + BLOCK / 2) / BLOCK * BLOCK;
+            if (rb > n) rb = n;
+            if (rb < beg[t - 1]) rb = beg[t - 1];
+            beg[t] = rb;
+        }
+        beg[nthreads] = n;
+
+        pool.Start(nthreads);
+        return true;
+    }
+
+    /*
+    * MatVec: y=A*x.
+    * @ax: double/complex array of length ap[n], matrix values
+    * @x: double/complex array of length n
+    * @y: double/complex array of length n to get the product (must not overlap x)
+    * @is_complex: complex or real
+    */
+    void MatVec(const double ax[], const double x[], double y[], bool is_complex)
+    {
+        Task tk = { ax, x, NULL, y, is_complex, NULL, NULL };
+        Run(tk);
+    }
+
+    /*
+    * Residual: r=b-A*x, returns the L2 norm of r.
+    * @r: double/complex array of length n to get the residual (can be NULL if only the norm is needed, can be the same address as b)
+    * @berr: pointer to a double to retrieve the componentwise backward error max(|r_i|/(|A|*|x|+|b|)_i) (can be NULL if not needed)
+    */
+    double Residual(const double ax[], const double x[], const double b[], double r[], bool is_complex, double *berr)
+    {
+        const size_t nb = ((size_t)n + BLOCK - 1) / BLOCK;
+        std::vector<double> part(nb + nthreads, 0.);
+        Task tk = { ax, x, b, r, is_complex, &part[0], &part[nb] };
+        Run(tk);
+        double s = 0., e = 0.;
+        for (size_t k = 0; k < nb; ++k) s += part[k];
+        for (int t = 0; t < nthreads; ++t)
+        {
+            if (part[nb + t] > e) e = part[nb + t];
+        }
+        if (berr != NULL) *berr = e;
+        return sqrt(s);
+    }
+
+    int Threads() const
+    {
+        return nthreads;
+    }
+
+private:
+    struct Task
+    {
+        const double *ax;
+        const double *x;
+        const double *b; //NULL for MatVec
+        double *y;
+        bool is_complex;
+        double *sum; //per-block squared norm of residual
+        double *err; //per-thread backward error
+    };
+
+    size_t RowEnd(INT i) const
+    {
+        return (NULL != ap) ? (size_t)ap[i + 1] : tp[(size_t)i + 1];
+    }
+
+    void Kernel(const Task &tk, int t) const
+    {
+        const INT rb = beg[t];
+        const INT re = beg[t + 1];
+        double s2 = 0., e = 0.;
+        for (INT i = rb; i < re; ++i)
+        {
+            const size_t start = (NULL != ap) ? (size_t)ap[i] : tp[(size_t)i];
+            const size_t end = RowEnd(i);
+            if (!tk.is_complex)
+            {
+                double s = 0., d = 0.;
+                for (size_t p = start; p < end; ++p)
+                {
+                    const size_t v = (NULL != ap) ? p : tv[p];
+                    const INT j = (NULL != ap) ? ai[p] : ti[p];
+                    const double a = tk.ax[v] * tk.x[j];
+                    s += a;
+                    d += fabs(a);
+                }
+                if (NULL == tk.b)
+                {
+                    tk.y[i] = s;
+                    continue;
+                }
+                s = tk.b[i] - s;
+                d += fabs(tk.b[i]);
+                if (NULL != tk.y) tk.y[i] = s;
+                s2 += s * s;
+                if (d > 0.)
+                {
+                    if (fabs(s) > e * d) e = fabs(s) / d;
+                }
+                else if (s != 0.) e = HUGE_VAL;
+            }
+            else
+            {
+                double sr = 0., si = 0., d = 0.;
+                for (size_t p = start; p < end; ++p)
+                {
+                    const size_t v = (NULL != ap) ? p : tv[p];
+                    const INT j = (NULL != ap) ? ai[p] : ti[p];
+                    const double a0 = tk.ax[v + v];
+                    const double a1 = tk.ax[v + v + 1];
+                    const double x0 = tk.x[j + j];
+                    const double x1 = tk.x[j + j + 1];
+                    const double t0 = a0 * x0 - a1 * x1;
+                    const double t1 = a0 * x1 + a1 * x0;
+                    sr += t0;
+                    si += t1;
+                    d += sqrt(t0 * t0 + t1 * t1);
+                }
+                if (NULL == tk.b)
+                {
+                    tk.y[i + i] = sr;
+                    tk.y[i + i + 1] = si;
+                    continue;
+                }
+                sr = tk.b[i + i] - sr;
+                si = tk.b[i + i + 1] - si;
+                d += sqrt(tk.b[i + i] * tk.b[i + i] + tk.b[i + i + 1] * tk.b[i + i + 1]);
+                if (NULL != tk.y)
+                {
+                    tk.y[i + i] = sr;
+                    tk.y[i + i + 1] = si;
+                }
+                const double s = sr * sr + si * si;
+                s2 += s;
+                if (d > 0.)
+                {
+                    if (s > e * e * d * d) e = sqrt(s) / d;
+                }
+                else if (s != 0.) e = HUGE_VAL;
+            }
+            if (NULL != tk.sum && ((i + 1) % BLOCK == 0 || i + 1 == re))
+            {
+                tk.sum[(size_t)i / BLOCK] = s2;
+                s2 = 0.;
+            }
+        }
+        if (NULL != tk.err) tk.err[t] = e;
+    }
+
+    void Run(const Task &tk)
+    {
+        pool.Run([this, &tk](int t) { Kernel(tk, t); });
+    }
+
+    INT n;
+    const INT *ap; //row-mode pattern (NULL in column mode)
+    const INT *ai;
+    std::vector<size_t> tp; //transposed pattern for column mode
+    std::vector<INT> ti;
+    std::vector<size_t> tv; //positions into ax
+    std::vector<INT> beg; //row partition, beg[t]~beg[t+1]-1 for thread t
+    int nthreads;
+    WorkerPool pool;
+};
+
+#endif
@@ -0,0 +1,542 @@
+/*
+* Matrix file loader for the demos: Matrix Market (.mtx) text files and a compact binary format for fast reloads.
+* Text files are memory-mapped and parsed by several threads, each on a range of lines. Entries can be in any order; symmetric,
+* skew-symmetric and hermitian files are expanded to the full matrix, pattern files get 1.0 values, and duplicated entries are
+* summed. Like ReadMtxFile in the demos, the result is compressed by columns of the file (ap: column pointers, ai: row indexes,
+* sorted in each column), which the demos pass to CKTSO as row-mode arrays.
+* Binary file layout (little-endian): "CKTSOBIN", int32 version (1), int32 flags (1=complex), int64 n, int64 nnz, then ap (n+1
+* int64), ai (nnz int64) and ax (nnz doubles, or 2*nnz doubles interleaved for complex).
+*/
+
+#ifndef __CKTSO_MTXIO__
+#define __CKTSO_MTXIO__
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <new>
+#ifdef _MSC_VER
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/*
+* MappedFile: read-only memory mapping of a whole file.
+*/
+class MappedFile
+{
+public:
+    MappedFile() : data(NULL), size(0)
+#ifdef _MSC_VER
+        , file(INVALID_HANDLE_VALUE), mapping(NULL)
+#endif
+    {
+    }
+
+    ~MappedFile()
+    {
+        Close();
+    }
+
+    bool Open(const char name[])
+    {
+        Close();
+#ifdef _MSC_VER
+        file = CreateFileA(name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (INVALID_HANDLE_VALUE == file) return false;
+        LARGE_INTEGER len;
+        if (!GetFileSizeEx(file, &len)) return false;
+        size = (size_t)len.QuadPart;
+        if (0 == size) return true;
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (NULL == mapping) return false;
+        data = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        return NULL != data;
+#else
+        const int fd = open(name, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            close(fd);
+            return false;
+        }
+        size = (size_t)st.st_size;
+        if (0 == size)
+        {
+            close(fd);
+            return true;
+        }
+        void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (MAP_FAILED == p) return false;
+        data = (const char *)p;
+        return true;
+#endif
+    }
+
+    void Close()
+    {
+#ifdef _MSC_VER
+        if (NULL != data) UnmapViewOfFile(data);
+        if (NULL != mapping) CloseHandle(mapping);
+        if (INVALID_HANDLE_VALUE != file) CloseHandle(file);
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (NULL != data) munmap((void *)data, size);
+#endif
+        data = NULL;
+        size = 0;
+    }
+
+    const char *Data() const
+    {
+        return data;
+    }
+
+    size_t Size() const
+    {
+        return size;
+    }
+
+private:
+    const char *data;
+    size_t size;
+#ifdef _MSC_VER
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+namespace mtxio_detail
+{
+    struct Triplet
+    {
+        long long r;
+        long long c;
+        double v[2];
+    };
+
+    inline const char *SkipBlank(const char *p, const char *end)
+    {
+        while (p < end && (' ' == *p || '\t' == *p || '\r' == *p)) ++p;
+        return p;
+    }
+
+    inline const char *NextLine(const char *p, const char *end)
+    {
+        while (p < end && *p != '\n') ++p;
+        return (p < end) ? p + 1 : end;
+    }
+
+    inline bool ParseInt(const char *&p, const char *end, long long &v)
+    {
+        p = SkipBlank(p, end);
+        bool neg = false;
+        if (p < end && ('-' == *p || '+' == *p)) neg = ('-' == *p++);
+        if (p >= end || *p < '0' || *p > '9') return false;
+        v = 0;
+        while (p < end && *p >= '0' && *p <= '9') v = v * 10 + (*p++ - '0');
+        if (neg) v = -v;
+        return true;
+    }
+
+    inline bool ParseDouble(const char *&p, const char *end, double &v)
+    {
+        //Tokens are copied so strtod never reads past the mapping, which has no terminating zero
+        p = SkipBlank(p, end);
+        char buf[64];
+        size_t len = 0;
+        while (p < end && len < sizeof(buf) - 1 && ' ' != *p && '\t' != *p && '\r' != *p && '\n' != *p) buf[len++] = *p++;
+        if (0 == len) return false;
+        buf[len] = '\0';
+        char *q;
+        v = strtod(buf, &q);
+        return q != buf;
+    }
+
+    /*
+    * ParseRange: parses the entry lines in [p, end), returns false on a malformed line.
+    */
+    inline bool ParseRange(const char *p, const char *end, int nval, std::vector<Triplet> &out)
+    {
+        while (p < end)
+        {
+            const char *q = SkipBlank(p, end);
+            if (q >= end || '\n' == *q || '%' == *q)
+            {
+                p = NextLine(q, end);
+                continue;
+            }
+            Triplet t;
+            t.v[0] = 1.;
+            t.v[1] = 0.;
+            if (!ParseInt(q, end, t.r) || !ParseInt(q, end, t.c)) return false;
+            for (int k = 0; k < nval; ++k)
+            {
+                if (!ParseDouble(q, end, t.v[k])) return false;
+            }
+            out.push_back(t);
+            p = NextLine(q, end);
+        }
+        return true;
+    }
+}
+
+/*
+* LoadMtx: loads a Matrix Market coordinate file.
+* @threads: # of parsing threads (0=all hardware threads)
+* @is_complex: gets whether the values are complex (interleaved in ax)
+* @return: 0 for success, -1 if the file cannot be opened, -2 for format errors (including non-square matrices, indexes that do
+*          not fit INT, and an entry count different from the size line), -4 for out of memory
+*/
+template <typename INT>
+int LoadMtx(const char file[], INT &n, std::vector<INT> &ap, std::vector<INT> &ai, std::vector<double> &ax, bool &is_complex, int threads)
+{
+    using mtxio_detail::Triplet;
+    MappedFile mf;
+    if (!mf.Open(file)) return -1;
+    const char *p = mf.Data();
+    const char *end = p + mf.Size();
+
+    //Banner: %%MatrixMarket matrix coordinate <real|integer|complex|pattern> <general|symmetric|skew-symmetric|hermitian>
+    int nval = 1;
+    int sym = 0; //0: general, 1: symmetric, -1: skew-symmetric, 2: hermitian
+    is_complex = false;
+    if (end - p > 14 && 0 == strncmp(p, "%%MatrixMarket", 14))
+    {
+        const char *e = mtxio_detail::NextLine(p, end);
+        std::string banner(p, e);
+        for (size_t i = 0; i < banner.size(); ++i)
+        {
+            if (banner[i] >= 'A' && banner[i] <= 'Z') banner[i] = (char)(banner[i] - 'A' + 'a');
+        }
+        if (std::string::npos != banner.find(" array")) return -2;
+        if (std::string::npos != banner.find("complex"))
+        {
+            nval = 2;
+            is_complex = true;
+        }
+        else if (std::string::npos != banner.find("pattern")) nval = 0;
+        if (std::string::npos != banner.find("skew-symmetric")) sym = -1;
+        else if (std::string::npos != banner.find("symmetric")) sym = 1;
+        else if (std::string::npos != banner.find("hermitian")) sym = 2;
+    }
+
+    //Size line
+    long long rows = 0, cols = 0, nz = 0;
+    for (;;)
+    {
+        if (p >= end) return -2;
+        const char *q = mtxio_detail::SkipBlank(p, end);
+        if (q < end && '\n' != *q && '%' != *q)
+        {
+            if (!mtxio_detail::ParseInt(q, end, rows) || !mtxio_detail::ParseInt(q, end, cols) || !mtxio_detail::ParseInt(q, end, nz)) return -2;
+            p = mtxio_detail::NextLine(q, end);
+            break;
+        }
+        p = mtxio_detail::NextLine(q, end);
+    }
+    if (rows != cols || rows <= 0 || nz < 0 || (long long)(INT)rows != rows) return -2;
+
+    //Parallel parse, each thread takes a range of whole lines
+    if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+    if (threads <= 0) threads = 1;
+    const size_t len = (size_t)(end - p);
+    if ((size_t)threads > len / 65536 + 1) threads = (int)(len / 65536 + 1);
+    std::vector<const char *> beg(threads + 1);
+    beg[0] = p;
+    beg[threads] = end;
+    for (int t = 1; t < threads; ++t)
+    {
+        const char *s = p + len * t / threads;
+        beg[t] = (s > beg[t - 1]) ? mtxio_detail::NextLine(s - 1, end) : beg[t - 1];
+    }
+    std::vector<std::vector<Triplet> > part(threads);
+    std::vector<int> ok(threads, 0);
+    try
+    {
+        std::vector<std::thread> th;
+        for (int t = 1; t < threads; ++t)
+        {
+            th.push_back(std::thread([&, t]()
+            {
+                try
+                {
+                    part[t].reserve((size_t)(nz / threads + 16));
+                    ok[t] = mtxio_detail::ParseRange(beg[t], beg[t + 1], nval, part[t]) ? 1 : 0;
+                }
+                catch (std::bad_alloc &)
+                {
+                    ok[t] = -1;
+                }
+            }));
+        }
+        part[0].reserve((size_t)(nz / threads + 16));
+        ok[0] = mtxio_detail::ParseRange(beg[0], beg[1], nval, part[0]) ? 1 : 0;
+        for (size_t t = 0; t < th.size(); ++t) th[t].join();
+    }
+    catch (std::bad_alloc &)
+    {
+        return -4;
+    }
+    for (int t = 0; t < threads; ++t)
+    {
+        if (ok[t] < 0) return -4;
+        if (0 == ok[t]) return -2;
+    }
+    mf.Close();
+    long long parsed = 0;
+    for (int t = 0; t < threads; ++t) parsed += (long long)part[t].size();
+    if (parsed != nz) return -2;
+
+    //Count by column (with mirrored entries), check indexes
+    try
+    {
+        n = (INT)rows;
+        std::vector<long long> cnt(rows + 1, 0);
+        for (int t = 0; t < threads; ++t)
+        {
+            for (size_t e = 0; e < part[t].size(); ++e)
+            {
+                Triplet &x = part[t][e];
+                if (x.r < 1 || x.r > rows || x.c < 1 || x.c > cols) return -2;
+                --x.r;
+                --x.c;
+                ++cnt[x.c + 1];
+                if (0 != sym && x.r != x.c) ++cnt[x.r + 1];
+            }
+        }
+        for (long long j = 0; j < rows; ++j) cnt[j + 1] += cnt[j];
+        const long long total = cnt[rows];
+        if ((long long)(INT)total != total) return -2;
+
+        //Scatter into columns, then sort each column and sum duplicates
+        std::vector<long long> pos(cnt.begin(), cnt.end() - 1);
+        std::vector<long long> ri(total);
+        const int w = is_complex ? 2 : 1;
+        std::vector<double> rv(total * w);
+        for (int t = 0; t < threads; ++t)
+        {
+            for (size_t e = 0; e < part[t].size(); ++e)
+            {
+                const Triplet &x = part[t][e];
+                long long q = pos[x.c]++;
+                ri[q] = x.r;
+                rv[q * w] = x.v[0];
+                if (2 == w) rv[q * w + 1] = x.v[1];
+                if (0 != sym && x.r != x.c)
+                {
+                    q = pos[x.r]++;
+                    ri[q] = x.c;
+                    rv[q * w] = (sym < 0) ? -x.v[0] : x.v[0];
+                    if (2 == w) rv[q * w + 1] = (sym < 0 || 2 == sym) ? -x.v[1] : x.v[1];
+                }
+            }
+            std::vector<Triplet>().swap(part[t]);
+        }
+
+        ap.assign((size_t)rows + 1, 0);
+        ai.resize(total);
+        ax.resize(total * w);
+        std::vector<long long> newcnt(rows, 0);
+        std::vector<std::thread> th;
+        for (int t = 0; t < threads; ++t)
+        {
+            const long long c0 = rows * t / threads;
+            const long long c1 = rows * (t + 1) / threads;
+            th.push_back(std::thread([&, c0, c1]()
+            {
+                std::vector<std::pair<long long, long long> > col;
+                for (long long j = c0; j < c1; ++j)
+                {
+                    col.clear();
+                    for (long long q = cnt[j]; q < cnt[j + 1]; ++q) col.push_back(std::make_pair(ri[q], q));
+                    std::sort(col.begin(), col.end());
+                    long long o = cnt[j];
+                    for (size_t e = 0; e < col.size(); ++e)
+                    {
+                        const long long q = col[e].second;
+                        if (o > cnt[j] && (long long)ai[o - 1] == col[e].first)
+                        {
+                            for (int k = 0; k < w; ++k) ax[(o - 1) * w + k] += rv[q * w + k];
+                            continue;
+                        }
+                        ai[o] = (INT)col[e].first;
+                        for (int k = 0; k < w; ++k) ax[o * w + k] = rv[q * w + k];
+                        ++o;
+                    }
+                    newcnt[j] = o - cnt[j];
+                }
+            }));
+        }
+        for (size_t t = 0; t < th.size(); ++t) th[t].join();
+
+        //Compact columns that had duplicates
+        long long o = 0;
+        for (long long j = 0; j < rows; ++j)
+        {
+            const long long s = cnt[j];
+            if (o != s)
+            {
+                memmove(&ai[o], &ai[s], sizeof(INT) * newcnt[j]);
+                memmove(&ax[o * w], &ax[s * w], sizeof(double) * w * newcnt[j]);
+            }
+            o += newcnt[j];
+            ap[j + 1] = (INT)o;
+        }
+        ai.resize(o);
+        ax.resize(o * w);
+    }
+    catch (std::bad_alloc &)
+    {
+        return -4;
+    }
+    return 0;
+}
+
+/*
+* SaveBinary: writes a matrix in the binary format.
+* @return: 0 for success, -1 if the file cannot be written
+*/
+template <typename INT>
+int SaveBinary(const char file[], INT n, const INT ap[], const INT ai[], const double ax[], bool is_complex)
+{
+    FILE *fp = fopen(file, "wb");
+    if (NULL == fp) return -1;
+    const int head[2] = { 1, is_complex ? 1 : 0 };
+    const long long nn = (long long)n;
+    const long long nnz = (long long)ap[n];
+    bool ok = fwrite("CKTSOBIN", 1, 8, fp) == 8 && fwrite(head, sizeof(int), 2, fp) == 2 && fwrite(&nn, sizeof(long long), 1, fp) == 1
+        && fwrite(&nnz, sizeof(long long), 1, fp) == 1;
+    std::vector<long long> buf;
+    if (ok)
+    {
+        buf.assign(ap, ap + n + 1);
+        ok = fwrite(&buf[0], sizeof(long long), buf.size(), fp) == buf.size();
+    }
+    if (ok && nnz > 0)
+    {
+        buf.assign(ai, ai + nnz);
+        ok = fwrite(&buf[0], sizeof(long long), buf.size(), fp) == buf.size();
+    }
+    const size_t nv = (size_t)nnz * (is_complex ? 2 : 1);
+    if (ok && nv > 0) ok = fwrite(ax, sizeof(double), nv, fp) == nv;
+    if (fclose(fp) != 0) ok = false;
+    return ok ? 0 : -1;
+}
+
+/*
+* LoadBinary: reads a matrix written by SaveBinary.
+* @return: 0 for success, -1 if the file cannot be opened, -2 for format errors (including decreasing column pointers and row
+*          indexes out of [0,n)), -4 for out of memory
+*/
+template <typename INT>
+int LoadBinary(const char file[], INT &n, std::vector<INT> &ap, std::vector<INT> &ai, std::vector<double> &ax, bool &is_complex)
+{
+    MappedFile mf;
+    if (!mf.Open(file)) return -1;
+    const char *p = mf.Data();
+    const size_t size = mf.Size();
+    if (size < 32 || 0 != memcmp(p, "CKTSOBIN", 8)) return -2;
+    int head[2];
+    long long nn, nnz;
+    memcpy(head, p + 8, sizeof(head));
+    memcpy(&nn, p + 16, sizeof(long long));
+    memcpy(&nnz, p + 24, sizeof(long long));
+    if (1 != head[0] || nn <= 0 || nnz < 0 || (long long)(INT)nn != nn || (long long)(INT)nnz != nnz) return -2;
+    is_complex = (0 != (head[1] & 1));
+    const size_t w = is_complex ? 2 : 1;
+    if (size != 32 + sizeof(long long) * ((size_t)nn + 1 + (size_t)nnz) + sizeof(double) * w * (size_t)nnz) return -2;
+    try
+    {
+        n = (INT)nn;
+        const long long *sp = (const long long *)(p + 32);
+        const long long *si = sp + nn + 1;
+        ap.assign(sp, sp + nn + 1);
+        ai.assign(si, si + nnz);
+        ax.resize(w * (size_t)nnz);
+        if (nnz > 0) memcpy(&ax[0], si + nnz, sizeof(double) * ax.size());
+    }
+    catch (std::bad_alloc &)
+    {
+        return -4;
+    }
+    if (ap[0] != 0 || (long long)ap[n] != nnz) return -2;
+    for (INT j = 0; j < n; ++j)
+    {
+        if (ap[j] > ap[j + 1]) return -2;
+    }
+    for (size_t q = 0; q < ai.size(); ++q)
+    {
+        if (ai[q] < 0 || ai[q] >= n) return -2;
+    }
+    return 0;
+}
+
+/*
+* LoadMatrix: loads a binary file (by its magic) or a Matrix Market file.
+*/
+template <typename INT>
+int LoadMatrix(const char file[], INT &n, std::vector<INT> &ap, std::vector<INT> &ai, std::vector<double> &ax, bool &is_complex, int threads)
+{
+    FILE *fp = fopen(file, "rb");
+    if (NULL == fp) return -1;
+    char magic[8] = { 0 };
+    const size_t got = fread(magic, 1, 8, fp);
+    fclose(fp);
+    if (8 == got && 0 == memcmp(magic, "CKTSOBIN", 8)) return LoadBinary(file, n, ap, ai, ax, is_complex);
+    return LoadMtx(file, n, ap, ai, ax, is_complex, threads);
+}
+
+/*
+* ReadMtxFile: loads a matrix by LoadMatrix into arrays allocated by new[], printing the error, as the demos use it.
+* @is_complex: NULL to accept only real matrices, otherwise gets whether the values are complex (ax then holds 2*nnz interleaved
+*              values)
+*/
+inline bool ReadMtxFile(const char file[], int &n, int *&ap, int *&ai, double *&ax, bool *is_complex = NULL)
+{
+    std::vector<int> vp, vi;
+    std::vector<double> vx;
+    bool cx;
+    const int ret = LoadMatrix(file, n, vp, vi, vx, cx, 0);
+    if (ret < 0)
+    {
+        if (-1 == ret) printf("Cannot open file \"%s\".\n", file);
+        else if (-4 == ret) printf("Malloc for matrix failed.\n");
+        else printf("Invalid or non-square matrix file \"%s\".\n", file);
+        return false;
+    }
+    if (NULL != is_complex) *is_complex = cx;
+    else if (cx)
+    {
+        printf("Matrix \"%s\" is complex.\n", file);
+        return false;
+    }
+
+    ap = new int [n + 1];
+    ai = new int [vi.size() + 1];
+    ax = new double [vx.size() + 1];
+    if (NULL == ap || NULL == ai || NULL == ax)
+    {
+        printf("Malloc for matrix failed.\n");
+        return false;
+    }
+    memcpy(ap, &vp[0], sizeof(int) * (n + 1));
+    if (!vi.empty()) memcpy(ai, &vi[0], sizeof(int) * vi.size());
+    if (!vx.empty()) memcpy(ax, &vx[0], sizeof(double) * vx.size());
+    return true;
+}
+
+#endif
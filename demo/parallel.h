@@ -0,0 +1,199 @@
+/*
+* Building blocks shared by the parallel helpers of the demos (matvec.h, scaling.h, hybridsolve.h, demo_selinv.cpp): a pool of
+* persistent worker threads, a spinning barrier for the threads of one task, and the transposed pattern of CSR/CSC arrays with
+* positions into the original values.
+*/
+
+#ifndef __CKTSO_PARALLEL__
+#define __CKTSO_PARALLEL__
+#include <stddef.h>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/*
+* WorkerPool: Run(func) calls func(t) for t=0~Threads()-1 and returns when all calls are done. func(0) runs on the calling thread,
+* the others on threads created once by Start, so repeated calls do not pay for thread creation.
+*/
+class WorkerPool
+{
+public:
+    WorkerPool() : nthreads(1), gen(0), done(0), quit(false), call(NULL), arg(NULL)
+    {
+    }
+
+    ~WorkerPool()
+    {
+        Stop();
+    }
+
+    /*
+    * Start: stops the current workers and creates threads-1 new ones.
+    * @threads: # of threads including the calling thread (<=0 means 1)
+    */
+    void Start(int threads)
+    {
+        Stop();
+        nthreads = (threads > 0) ? threads : 1;
+        gen = 0;
+        done = 0;
+        quit = false;
+        for (int t = 1; t < nthreads; ++t) workers.push_back(std::thread(&WorkerPool::Worker, this, t));
+    }
+
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            quit = true;
+        }
+        cv.notify_all();
+        for (size_t t = 0; t < workers.size(); ++t) workers[t].join();
+        workers.clear();
+    }
+
+    template <typename FUNC>
+    void Run(const FUNC &func)
+    {
+        if (nthreads <= 1)
+        {
+            func(0);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            call = &Call<FUNC>;
+            arg = &func;
+            done = 0;
+            ++gen;
+        }
+        cv.notify_all();
+        func(0);
+        std::unique_lock<std::mutex> lk(mtx);
+        cv_done.wait(lk, [this] { return done == nthreads - 1; });
+        call = NULL;
+        arg = NULL;
+    }
+
+    int Threads() const
+    {
+        return nthreads;
+    }
+
+private:
+    template <typename FUNC>
+    static void Call(const void *f, int t)
+    {
+        (*(const FUNC *)f)(t);
+    }
+
+    void Worker(int t)
+    {
+        unsigned long long seen = 0;
+        for (;;)
+        {
+            void (*c)(const void *, int);
+            const void *a;
+            {
+                std::unique_lock<std::mutex> lk(mtx);
+                cv.wait(lk, [this, seen] { return quit || gen != seen; });
+                if (quit) return;
+                seen = gen;
+                c = call;
+                a = arg;
+            }
+            c(a, t);
+            {
+                std::lock_guard<std::mutex> lk(mtx);
+                ++done;
+            }
+            cv_done.notify_one();
+        }
+    }
+
+    int nthreads;
+    std::vector<std::thread> workers;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::condition_variable cv_done;
+    unsigned long long gen;
+    int done;
+    bool quit;
+    void (*call)(const void *, int);
+    const void *arg;
+};
+
+/*
+* SpinBarrier: barrier of the threads of one WorkerPool::Run, for level-synchronized kernels. Waiting threads spin briefly before
+* yielding, since the work between two barriers is often a few microseconds.
+*/
+class SpinBarrier
+{
+public:
+    SpinBarrier() : count(1), arrived(0), phase(0)
+    {
+    }
+
+    /*
+    * Reset: sets the # of threads, call it before the threads start.
+    */
+    void Reset(int threads)
+    {
+        count = threads;
+        arrived = 0;
+        phase = 0;
+    }
+
+    void Wait()
+    {
+        if (count <= 1) return;
+        const unsigned g = phase.load(std::memory_order_acquire);
+        if (arrived.fetch_add(1, std::memory_order_acq_rel) == count - 1)
+        {
+            arrived.store(0, std::memory_order_relaxed);
+            phase.store(g + 1, std::memory_order_release);
+            return;
+        }
+        for (int spin = 0; phase.load(std::memory_order_acquire) == g; ++spin)
+        {
+            if (spin > 256) std::this_thread::yield();
+        }
+    }
+
+private:
+    int count;
+    std::atomic<int> arrived;
+    std::atomic<unsigned> phase;
+};
+
+/*
+* TransposePattern: pattern of the transpose of the n x n matrix (ap, ai), keeping positions into the original values, so a pass
+* over the columns of a CSR matrix (or the rows of a CSC matrix) is a gather.
+* @tp: gets n+1 pointers
+* @ti: gets ap[n] indexes
+* @tv: gets ap[n] positions into the original values
+*/
+template <typename INT>
+void TransposePattern(INT n, const INT ap[], const INT ai[], std::vector<size_t> &tp, std::vector<INT> &ti, std::vector<size_t> &tv)
+{
+    const size_t nnz = (size_t)ap[n];
+    tp.assign((size_t)n + 1, 0);
+    ti.resize(nnz);
+    tv.resize(nnz);
+    for (size_t p = 0; p < nnz; ++p) ++tp[(size_t)ai[p] + 1];
+    for (INT i = 0; i < n; ++i) tp[(size_t)i + 1] += tp[(size_t)i];
+    std::vector<size_t> next(tp.begin(), tp.end() - 1);
+    for (INT i = 0; i < n; ++i)
+    {
+        for (size_t p = (size_t)ap[i]; p < (size_t)ap[i + 1]; ++p)
+        {
+            const size_t q = next[(size_t)ai[p]]++;
+            ti[q] = i;
+            tv[q] = p;
+        }
+    }
+}
+
+#endif
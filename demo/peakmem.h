@@ -0,0 +1,103 @@
+/*
+* Process memory probes, used to report the peak memory of one phase (e.g., CKTSO(_L)_Analyze) separately from oparm[13], which
+* only counts the memory held by the solver instance, not the transient workspace of ordering.
+* On Linux the peak (VmHWM) can be reset by /proc/self/clear_refs, so the peak of each phase is exact. Elsewhere the peak cannot be
+* reset and ResetPeakMemory returns false; the peak is then the one since the process started.
+*/
+
+#ifndef __CKTSO_PEAKMEM__
+#define __CKTSO_PEAKMEM__
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "psapi.lib")
+#endif
+#else
+#include <sys/resource.h>
+#endif
+
+#ifdef __linux__
+//Reads a "Name: value kB" line of /proc/self/status, in bytes
+inline long long __ProcStatus(const char name[])
+{
+    FILE *fp = fopen("/proc/self/status", "r");
+    if (NULL == fp) return -1;
+    char buf[256];
+    long long v = -1;
+    const size_t len = strlen(name);
+    while (fgets(buf, 256, fp) != NULL)
+    {
+        if (0 == strncmp(buf, name, len) && ':' == buf[len])
+        {
+            if (sscanf(buf + len + 1, "%lld", &v) == 1) v *= 1024;
+            break;
+        }
+    }
+    fclose(fp);
+    return v;
+}
+#endif
+
+/*
+* CurrentMemory: resident memory (bytes) of the process, -1 if unavailable.
+*/
+inline long long CurrentMemory()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return -1;
+    return (long long)pmc.WorkingSetSize;
+#elif defined(__linux__)
+    return __ProcStatus("VmRSS");
+#else
+    return -1;
+#endif
+}
+
+/*
+* PeakMemory: peak resident memory (bytes) of the process since it started or since the last successful ResetPeakMemory.
+*/
+inline long long PeakMemory()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return -1;
+    return (long long)pmc.PeakWorkingSetSize;
+#else
+#ifdef __linux__
+    const long long v = __ProcStatus("VmHWM");
+    if (v >= 0) return v;
+#endif
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return -1;
+#ifdef __APPLE__
+    return (long long)ru.ru_maxrss; //bytes
+#else
+    return (long long)ru.ru_maxrss * 1024; //kilobytes
+#endif
+#endif
+}
+
+/*
+* ResetPeakMemory: resets the peak to the current resident memory.
+* @return: false if not supported
+*/
+inline bool ResetPeakMemory()
+{
+#ifdef __linux__
+    FILE *fp = fopen("/proc/self/clear_refs", "w");
+    if (NULL == fp) return false;
+    const bool ok = fputs("5", fp) >= 0;
+    return (0 == fclose(fp)) && ok;
+#else
+    return false;
+#endif
+}
+
+#endif
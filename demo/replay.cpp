@@ -0,0 +1,349 @@
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS		1
+#define _CRT_NONSTDC_NO_WARNINGS	1
+#define _CRT_SECURE_NO_DEPRECATE	1
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <vector>
+#include <chrono>
+#include "cktso.h"
+#include "cktso_capture.h"
+#ifdef _MSC_VER
+#pragma comment(lib, "cktso.lib")
+#endif
+
+/*
+* Replays a trace written in capture mode (see cktso_capture.h) at full speed and compares the recorded and replayed times of each
+* kind of call. Calls whose values were not sampled reuse the last recorded values of the same matrix, which keeps the pivoting,
+* fill-in and work of every call the same as long as the sampled values are representative.
+*/
+
+static const char *OpName(int op)
+{
+    static const char *const names[CKTSO_TRACE_OPS] = { "", "Analyze", "Factorize", "Refactorize", "Solve", "SolveMV", "SortFactors",
+        "Statistics", "CleanUpGarbage", "Determinant", "FactorizeAndSolve", "RefactorizeAndSolve", "ExtractFactors" };
+    return (op > 0 && op < CKTSO_TRACE_OPS) ? names[op] : "unknown";
+}
+
+static long long Now()
+{
+    return (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct OpStat
+{
+    int calls;
+    int skipped;
+    int mismatched; //return code differs from the recorded one
+    long long rec_total, rec_min;
+    long long rep_total, rep_min;
+};
+
+//Sequential reader of one record payload
+class Payload
+{
+public:
+    Payload(const std::vector<char> &buf) : p(buf.data()), end(buf.data() + buf.size())
+    {
+    }
+
+    int Int()
+    {
+        int v = 0;
+        Get(&v, sizeof(int));
+        return v;
+    }
+
+    long long LongLong()
+    {
+        long long v = 0;
+        Get(&v, sizeof(long long));
+        return v;
+    }
+
+    bool Get(void *dst, size_t bytes)
+    {
+        if ((size_t)(end - p) < bytes) return false;
+        memcpy(dst, p, bytes);
+        p += bytes;
+        return true;
+    }
+
+private:
+    const char *p;
+    const char *end;
+};
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: replay <trace file> [-v]\n");
+        printf("Traces are written by applications that create solvers with CaptureCreateSolver (cktso_capture.h) and run with\n");
+        printf("CKTSO_CAPTURE=<trace file>. -v prints every call.\n");
+        printf("Example: CKTSO_CAPTURE=add20.trc ./benchmark add20.mtx 0 && ./replay add20.trc\n");
+        return -1;
+    }
+    const bool verbose = (argc > 2 && 0 == strcmp(argv[2], "-v"));
+
+    FILE *fp = fopen(argv[1], "rb");
+    if (NULL == fp)
+    {
+        printf("Cannot open file \"%s\".\n", argv[1]);
+        return -1;
+    }
+    char magic[8];
+    int version = 0, np = 0;
+    if (fread(magic, 1, 8, fp) != 8 || memcmp(magic, CKTSO_TRACE_MAGIC, 8) != 0 || fread(&version, sizeof(int), 1, fp) != 1
+        || fread(&np, sizeof(int), 1, fp) != 1 || version != CKTSO_TRACE_VERSION || np < 0 || np > 64)
+    {
+        printf("\"%s\" is not a CKTSO trace of version %d.\n", argv[1], CKTSO_TRACE_VERSION);
+        fclose(fp);
+        return -1;
+    }
+
+    ICktSo instance = NULL;
+    int *iparm;
+    const long long *oparm;
+    int ret = CKTSO_CreateSolver(&instance, &iparm, &oparm);
+    if (ret < 0)
+    {
+        printf("Failed to create solver instance, return code = %d.\n", ret);
+        fclose(fp);
+        return ret;
+    }
+
+    OpStat stat[CKTSO_TRACE_OPS];
+    memset(stat, 0, sizeof(stat));
+    for (int k = 0; k < CKTSO_TRACE_OPS; ++k) stat[k].rec_min = stat[k].rep_min = LLONG_MAX;
+
+    //State of the replayed solver
+    bool is_complex = false;
+    int n = 0;
+    std::vector<int> ap, ai, snap(np);
+    std::vector<double> ax, b, bm, x;
+    std::vector<char> buf;
+    int analyzed = 0;
+
+    int op, rec_ret;
+    long long rec_ns, len;
+    int index = 0;
+    while (fread(&op, sizeof(int), 1, fp) == 1 && fread(&rec_ret, sizeof(int), 1, fp) == 1
+        && fread(&rec_ns, sizeof(long long), 1, fp) == 1 && fread(&len, sizeof(long long), 1, fp) == 1)
+    {
+        if (len < 0) break;
+        buf.resize((size_t)len);
+        if (len > 0 && fread(buf.data(), 1, (size_t)len, fp) != (size_t)len) break; //truncated trace
+        Payload pl(buf);
+        if (op <= 0 || op >= CKTSO_TRACE_OPS) continue;
+
+        const size_t w = is_complex ? 2 : 1;
+        bool run = true;
+        int vals;
+        long long rep_ns = 0;
+        switch (op)
+        {
+        case CKTSO_TRACE_ANALYZE:
+        {
+            is_complex = pl.Int() != 0;
+            n = pl.Int();
+            const int threads = pl.Int();
+            vals = pl.Int();
+            pl.Get(snap.data(), np * sizeof(int));
+            const size_t w2 = is_complex ? 2 : 1;
+            if (n > 0)
+            {
+                ap.resize((size_t)n + 1);
+                pl.Get(ap.data(), ap.size() * sizeof(int));
+                ai.resize((size_t)ap[n]);
+                pl.Get(ai.data(), ai.size() * sizeof(int));
+                ax.assign(ai.size() * w2, 0.);
+                if (vals) pl.Get(ax.data(), ax.size() * sizeof(double));
+                b.assign((size_t)n * w2, 1.);
+                x.resize(b.size());
+                bm.clear();
+            }
+            run = (n > 0);
+            if (run)
+            {
+                for (int k = 0; k < np; ++k) iparm[k] = snap[k];
+                const long long t0 = Now();
+                ret = instance->Analyze(is_complex, n, ap.data(), ai.data(), vals ? ax.data() : NULL, threads);
+                rep_ns = Now() - t0;
+                analyzed = (ret >= 0);
+            }
+            break;
+        }
+        case CKTSO_TRACE_FACTORIZE:
+        {
+            const bool fast = pl.Int() != 0;
+            vals = pl.Int();
+            pl.Get(snap.data(), np * sizeof(int));
+            if (vals) pl.Get(ax.data(), ax.size() * sizeof(double));
+            run = analyzed != 0;
+            if (run)
+            {
+                for (int k = 0; k < np; ++k) iparm[k] = snap[k];
+                const long long t0 = Now();
+                ret = instance->Factorize(ax.data(), fast);
+                rep_ns = Now() - t0;
+            }
+            break;
+        }
+        case CKTSO_TRACE_REFACTORIZE:
+            vals = pl.Int();
+            if (vals) pl.Get(ax.data(), ax.size() * sizeof(double));
+            run = analyzed != 0;
+            if (run)
+            {
+                const long long t0 = Now();
+                ret = instance->Refactorize(ax.data());
+                rep_ns = Now() - t0;
+            }
+            break;
+        case CKTSO_TRACE_SOLVE:
+        {
+            const bool force_seq = pl.Int() != 0;
+            const bool row0_column1 = pl.Int() != 0;
+            if (pl.Int()) pl.Get(b.data(), b.size() * sizeof(double));
+            run = analyzed != 0;
+            if (run)
+            {
+                const long long t0 = Now();
+                ret = instance->Solve(b.data(), x.data(), force_seq, row0_column1);
+                rep_ns = Now() - t0;
+            }
+            break;
+        }
+        case CKTSO_TRACE_SOLVEMV:
+        {
+            const size_t nrhs = (size_t)pl.LongLong();
+            const bool row0_column1 = pl.Int() != 0;
+            const size_t size = (size_t)n * w * nrhs;
+            if (bm.size() != size) bm.assign(size, 1.);
+            if (pl.Int()) pl.Get(bm.data(), size * sizeof(double));
+            run = analyzed != 0;
+            if (run)
+            {
+                std::vector<double> xm(size);
+                const long long t0 = Now();
+                ret = instance->SolveMV(nrhs, bm.data(), 0, xm.data(), 0, row0_column1);
+                rep_ns = Now() - t0;
+            }
+            break;
+        }
+        case CKTSO_TRACE_SORT_FACTORS:
+        {
+            const bool also_sort_values = pl.Int() != 0;
+            const long long t0 = Now();
+            ret = instance->SortFactors(also_sort_values);
+            rep_ns = Now() - t0;
+            break;
+        }
+        case CKTSO_TRACE_STATISTICS:
+        {
+            const bool row0_column1 = pl.Int() != 0;
+            const char scaling = (char)pl.Int();
+            const bool fuse_mac = pl.Int() != 0;
+            long long ff, sf, fm, sm;
+            const long long t0 = Now();
+            ret = instance->Statistics(&ff, &sf, &fm, &sm, row0_column1, scaling, fuse_mac);
+            rep_ns = Now() - t0;
+            break;
+        }
+        case CKTSO_TRACE_CLEAN_UP_GARBAGE:
+        {
+            const long long t0 = Now();
+            ret = instance->CleanUpGarbage();
+            rep_ns = Now() - t0;
+            break;
+        }
+        case CKTSO_TRACE_DETERMINANT:
+        {
+            double mantissa[2], exponent;
+            const long long t0 = Now();
+            ret = instance->Determinant(mantissa, &exponent);
+            rep_ns = Now() - t0;
+            break;
+        }
+        case CKTSO_TRACE_FACTORIZE_AND_SOLVE:
+        case CKTSO_TRACE_REFACTORIZE_AND_SOLVE:
+        {
+            const bool row0_column1 = pl.Int() != 0;
+            if (pl.Int())
+            {
+                pl.Get(ax.data(), ax.size() * sizeof(double));
+                pl.Get(b.data(), b.size() * sizeof(double));
+            }
+            run = analyzed != 0;
+            if (run)
+            {
+                const long long t0 = Now();
+                ret = (CKTSO_TRACE_FACTORIZE_AND_SOLVE == op) ? instance->FactorizeAndSolve(ax.data(), b.data(), x.data(), row0_column1)
+                    : instance->RefactorizeAndSolve(ax.data(), b.data(), x.data(), row0_column1);
+                rep_ns = Now() - t0;
+            }
+            break;
+        }
+        case CKTSO_TRACE_EXTRACT_FACTORS:
+        {
+            run = analyzed != 0 && oparm[5] > 0 && oparm[6] >= 0;
+            if (run)
+            {
+                std::vector<size_t> lp((size_t)n + 1), up((size_t)n + 1);
+                std::vector<int> li((size_t)oparm[5]), ui((size_t)oparm[6] + 1), rp(n), cp(n);
+                std::vector<double> lx((size_t)oparm[5] * w), ux(((size_t)oparm[6] + 1) * w), rs(n), cs(n);
+                const long long t0 = Now();
+                ret = instance->ExtractFactors(lp.data(), li.data(), lx.data(), up.data(), ui.data(), ux.data(), rp.data(), cp.data(), rs.data(), cs.data());
+                rep_ns = Now() - t0;
+            }
+            break;
+        }
+        }
+
+        OpStat &s = stat[op];
+        ++index;
+        if (!run)
+        {
+            ++s.skipped;
+            if (verbose) printf("#%d %s: skipped (matrix not analyzed).\n", index, OpName(op));
+            continue;
+        }
+        ++s.calls;
+        if (ret != rec_ret) ++s.mismatched;
+        s.rec_total += rec_ns;
+        s.rep_total += rep_ns;
+        if (rec_ns < s.rec_min) s.rec_min = rec_ns;
+        if (rep_ns < s.rep_min) s.rep_min = rep_ns;
+        if (verbose)
+        {
+            printf("#%d %s: recorded %.3f us (return %d), replayed %.3f us (return %d).\n", index, OpName(op), rec_ns * 1e-3, rec_ret,
+                rep_ns * 1e-3, ret);
+        }
+    }
+    fclose(fp);
+
+    printf("Replayed %d calls of \"%s\".\n", index, argv[1]);
+    printf("%-20s %8s %14s %14s %14s %14s %10s\n", "call", "count", "rec total(ms)", "rep total(ms)", "rec min(us)", "rep min(us)", "ret diff");
+    long long rec_sum = 0, rep_sum = 0;
+    for (int k = 1; k < CKTSO_TRACE_OPS; ++k)
+    {
+        const OpStat &s = stat[k];
+        if (0 == s.calls && 0 == s.skipped) continue;
+        if (s.calls > 0)
+        {
+            printf("%-20s %8d %14.3f %14.3f %14.3f %14.3f %10d\n", OpName(k), s.calls, s.rec_total * 1e-6, s.rep_total * 1e-6,
+                s.rec_min * 1e-3, s.rep_min * 1e-3, s.mismatched);
+        }
+        if (s.skipped > 0) printf("%-20s %8d skipped because the matrix was not analyzed.\n", OpName(k), s.skipped);
+        rec_sum += s.rec_total;
+        rep_sum += s.rep_total;
+    }
+    printf("Total: recorded %.3f ms, replayed %.3f ms.\n", rec_sum * 1e-6, rep_sum * 1e-6);
+
+    instance->DestroySolver();
+    return 0;
+}
@@ -0,0 +1,249 @@
+/*
+* Parallel equilibration scaling on the same CSR/CSC arrays passed to CKTSO(_L)_Analyze.
+* Works for both ICktSo (INT=int) and ICktSo_L (INT=long long), real and complex (interleaved) values.
+* Computes row and column scaling vectors Dr, Dc by the iterative infinity-norm equilibration of Ruiz, so that every row and column
+* of Dr*A*Dc has a max magnitude close to 1. Each iteration is one pass over the rows and one over the columns, split among threads
+* by the number of nonzeros, and the # of iterations is the quality-versus-speed knob (1 is a plain row/column equilibration).
+* Scaling factors are rounded to powers of 2, so scaling introduces no rounding error and x = Dc*y exactly undoes it.
+* Solving A*x=b with the scaled matrix: factorize Dr*A*Dc, solve (Dr*A*Dc)*y = Dr*b, then x = Dc*y.
+*/
+
+#ifndef __CKTSO_SCALING__
+#define __CKTSO_SCALING__
+#include <stddef.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <thread>
+#include "parallel.h"
+
+template <typename INT>
+class ParallelScaling
+{
+public:
+    ParallelScaling() : n(0), ap(NULL), ai(NULL), nthreads(1), time(0)
+    {
+    }
+
+    /*
+    * Initialize: binds the matrix pattern and starts the worker threads.
+    * @n: matrix dimension
+    * @ap: integer array of length n+1, matrix row (row mode) or column (column mode) pointers
+    * @ai: integer array of length ap[n], matrix column (row mode) or row (column mode) indexes
+    * @threads: # of threads (0=all hardware threads)
+    * The scaling is symmetric in rows and columns, so row and column modes give the same factors with Dr and Dc swapped.
+    */
+    bool Initialize(INT n_, const INT ap_[], const INT ai_[], int threads)
+    {
+        pool.Stop();
+        n = n_;
+        ap = ap_;
+        ai = ai_;
+        const size_t nnz = (size_t)ap[n];
+
+        //Transposed pattern, keeping positions into ax so column passes are gathers too
+        TransposePattern(n, ap, ai, tp, ti, tv);
+        rs.assign((size_t)n, 1.);
+        cs.assign((size_t)n, 1.);
+        rn.resize((size_t)n);
+        cn.resize((size_t)n);
+
+        if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+        if (threads <= 0) threads = 1;
+        if ((INT)threads > n) threads = (n > 0) ? (int)n : 1;
+        nthreads = threads;
+
+        //Partition rows and columns so that each thread gets about the same number of nonzeros
+        rbeg.assign((size_t)nthreads + 1, 0);
+        cbeg.assign((size_t)nthreads + 1, 0);
+        INT r = 0, c = 0;
+        for (int t = 1; t < nthreads; ++t)
+        {
+            const size_t target = nnz * t / nthreads;
+            while (r < n && (size_t)ap[r + 1] <= target) ++r;
+            while (c < n && tp[(size_t)c + 1] <= target) ++c;
+            rbeg[t] = r;
+            cbeg[t] = c;
+        }
+        rbeg[nthreads] = n;
+        cbeg[nthreads] = n;
+
+        pool.Start(nthreads);
+        return true;
+    }
+
+    /*
+    * Compute: computes the scaling vectors from the current values, starting from identity.
+    * @ax: double/complex array of length ap[n], matrix values
+    * @is_complex: complex or real
+    * @iterations: # of equilibration iterations (>=1), more iterations give a better balanced matrix
+    */
+    void Compute(const double ax[], bool is_complex, int iterations)
+    {
+        const auto t0 = std::chrono::steady_clock::now();
+        for (INT i = 0; i < n; ++i)
+        {
+            rs[(size_t)i] = 1.;
+            cs[(size_t)i] = 1.;
+        }
+        if (iterations < 1) iterations = 1;
+        for (int k = 0; k < iterations; ++k)
+        {
+            Task tk = { ax, NULL, is_complex, k + 1 == iterations };
+            Run(tk);
+            rs.swap(rn);
+            cs.swap(cn);
+        }
+        time = (long long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+    }
+
+    /*
+    * Apply: sx = Dr*A*Dc.
+    * @sx: double/complex array of length ap[n] to get the scaled values (can be the same address as ax)
+    */
+    void Apply(const double ax[], double sx[], bool is_complex)
+    {
+        Task tk = { ax, sx, is_complex, false };
+        Run(tk);
+    }
+
+    /*
+    * ScaleRhs: sb = Dr*b (row mode). ScaleSolution: x = Dc*y. Both can work in place.
+    */
+    void ScaleRhs(const double b[], double sb[], bool is_complex) const
+    {
+        Multiply(rs, b, sb, is_complex);
+    }
+
+    void ScaleSolution(const double y[], double x[], bool is_complex) const
+    {
+        Multiply(cs, y, x, is_complex);
+    }
+
+    const double *RowScale() const
+    {
+        return rs.data();
+    }
+
+    const double *ColumnScale() const
+    {
+        return cs.data();
+    }
+
+    /*
+    * Time: time (in microsecond/us) of the last Compute.
+    */
+    long long Time() const
+    {
+        return time;
+    }
+
+    int Threads() const
+    {
+        return nthreads;
+    }
+
+private:
+    struct Task
+    {
+        const double *ax;
+        double *sx; //NULL for an equilibration iteration
+        bool is_complex;
+        bool round; //round the new factors to powers of 2
+    };
+
+    static double Abs(const double ax[], size_t p, bool is_complex)
+    {
+        return is_complex ? sqrt(ax[p + p] * ax[p + p] + ax[p + p + 1] * ax[p + p + 1]) : fabs(ax[p]);
+    }
+
+    //Scale factor 1/sqrt(m), or 1 for an empty row/column
+    static double Factor(double s, double m, bool round)
+    {
+        if (!(m > 0.) || m == HUGE_VAL) return s;
+        const double f = s / sqrt(m);
+        if (!round) return f;
+        int e;
+        const double mant = frexp(f, &e);
+        return ldexp(1., mant > 0.70710678118654752 ? e : e - 1); //nearest power of 2 in log scale
+    }
+
+    static void Multiply(const std::vector<double> &d, const double v[], double w[], bool is_complex)
+    {
+        const size_t len = d.size();
+        for (size_t i = 0; i < len; ++i)
+        {
+            if (is_complex)
+            {
+                w[i + i] = v[i + i] * d[i];
+                w[i + i + 1] = v[i + i + 1] * d[i];
+            }
+            else w[i] = v[i] * d[i];
+        }
+    }
+
+    void Kernel(const Task &tk, int t)
+    {
+        const bool c = tk.is_complex;
+        if (NULL != tk.sx)
+        {
+            for (INT i = rbeg[t]; i < rbeg[t + 1]; ++i)
+            {
+                const double r = rs[(size_t)i];
+                for (size_t p = (size_t)ap[i]; p < (size_t)ap[i + 1]; ++p)
+                {
+                    const double f = r * cs[(size_t)ai[p]];
+                    if (c)
+                    {
+                        tk.sx[p + p] = tk.ax[p + p] * f;
+                        tk.sx[p + p + 1] = tk.ax[p + p + 1] * f;
+                    }
+                    else tk.sx[p] = tk.ax[p] * f;
+                }
+            }
+            return;
+        }
+
+        //Row and column max magnitudes of the currently scaled matrix, both from the factors of the previous iteration
+        for (INT i = rbeg[t]; i < rbeg[t + 1]; ++i)
+        {
+            double m = 0.;
+            for (size_t p = (size_t)ap[i]; p < (size_t)ap[i + 1]; ++p)
+            {
+                const double a = Abs(tk.ax, p, c) * cs[(size_t)ai[p]];
+                if (a > m) m = a;
+            }
+            rn[(size_t)i] = Factor(rs[(size_t)i], m * rs[(size_t)i], tk.round);
+        }
+        for (INT j = cbeg[t]; j < cbeg[t + 1]; ++j)
+        {
+            double m = 0.;
+            for (size_t q = tp[(size_t)j]; q < tp[(size_t)j + 1]; ++q)
+            {
+                const double a = Abs(tk.ax, tv[q], c) * rs[(size_t)ti[q]];
+                if (a > m) m = a;
+            }
+            cn[(size_t)j] = Factor(cs[(size_t)j], m * cs[(size_t)j], tk.round);
+        }
+    }
+
+    void Run(const Task &tk)
+    {
+        pool.Run([this, &tk](int t) { Kernel(tk, t); });
+    }
+
+    INT n;
+    const INT *ap;
+    const INT *ai;
+    std::vector<size_t> tp; //transposed pattern
+    std::vector<INT> ti;
+    std::vector<size_t> tv; //positions into ax
+    std::vector<double> rs, cs; //current scaling
+    std::vector<double> rn, cn; //next iteration
+    std::vector<INT> rbeg, cbeg; //row and column partitions
+    int nthreads;
+    long long time;
+    WorkerPool pool;
+};
+
+#endif
@@ -0,0 +1,119 @@
+/*
+* Split-complex wrapper of CKTSO: complex matrices and vectors are given as separate real and imaginary arrays (structure of arrays)
+* instead of interleaved re,im pairs. Works for both ICktSo (INT=int) and ICktSo_L (INT=long long).
+* The library kernels take interleaved data, so values are interleaved in one pass into buffers that are allocated at analysis and
+* reused by every call; no allocation happens in Factorize/Refactorize/Solve/SolveMV. Solve runs in place on the interleaved buffer,
+* and SolveMV on a buffer of max_nrhs vectors (set at analysis), solving more vectors in groups of max_nrhs.
+*/
+
+#ifndef __CKTSO_SPLITCOMPLEX__
+#define __CKTSO_SPLITCOMPLEX__
+#include <stddef.h>
+#include <vector>
+#include "cktso.h"
+
+template <typename HANDLE, typename INT>
+class SplitComplexSolver
+{
+public:
+    /*
+    * @instance: solver instance created by CKTSO_CreateSolver or CKTSO_L_CreateSolver, not destroyed by this class
+    */
+    explicit SplitComplexSolver(HANDLE instance) : inst(instance), n(0), nnz(0), group(1)
+    {
+    }
+
+    /*
+    * Analyze: the same as Analyze with is_complex=true.
+    * @axr: real parts of matrix values (length ap[n]), can be NULL together with axi if unavailable when analysis
+    * @axi: imaginary parts of matrix values (length ap[n])
+    * @max_nrhs: # of vectors SolveMV solves at once, more vectors are solved in groups
+    */
+    int Analyze(INT n_, const INT ap[], const INT ai[], const double axr[], const double axi[], int threads, size_t max_nrhs = 1)
+    {
+        n = (size_t)n_;
+        nnz = (size_t)ap[n_];
+        if (0 == max_nrhs) max_nrhs = 1;
+        ax.resize(nnz * 2);
+        v.resize(n * 2);
+        mv.resize(n * 2 * max_nrhs);
+        group = max_nrhs;
+        if (NULL == axr || NULL == axi) return inst->Analyze(true, n_, ap, ai, NULL, threads);
+        return inst->Analyze(true, n_, ap, ai, Interleave(axr, axi, nnz, &ax[0]), threads);
+    }
+
+    int Factorize(const double axr[], const double axi[], bool fast)
+    {
+        if (ax.empty()) return -8;
+        return inst->Factorize(Interleave(axr, axi, nnz, &ax[0]), fast);
+    }
+
+    int Refactorize(const double axr[], const double axi[])
+    {
+        if (ax.empty()) return -8;
+        return inst->Refactorize(Interleave(axr, axi, nnz, &ax[0]));
+    }
+
+    /*
+    * Solve: the same as Solve, with split right-hand-side and solution vectors (xr/xi can be the same addresses as br/bi).
+    */
+    int Solve(const double br[], const double bi[], double xr[], double xi[], bool force_seq, bool row0_column1)
+    {
+        if (v.empty()) return -8;
+        double *t = Interleave(br, bi, n, &v[0]);
+        const int ret = inst->Solve(t, t, force_seq, row0_column1);
+        if (ret >= 0) Deinterleave(t, n, xr, xi);
+        return ret;
+    }
+
+    /*
+    * SolveMV: the same as SolveMV, with split right-hand-side and solution vectors (solved in groups of max_nrhs of Analyze).
+    */
+    int SolveMV(size_t nrhs, const double br[], const double bi[], size_t ld_b, double xr[], double xi[], size_t ld_x, bool row0_column1)
+    {
+        if (mv.empty()) return -8;
+        if (0 == ld_b) ld_b = n;
+        if (0 == ld_x) ld_x = n;
+        double *t = &mv[0];
+        int ret = 0;
+        for (size_t k0 = 0; k0 < nrhs && ret >= 0; k0 += group)
+        {
+            const size_t m = (nrhs - k0 < group) ? nrhs - k0 : group;
+            for (size_t k = 0; k < m; ++k) Interleave(br + (k0 + k) * ld_b, bi + (k0 + k) * ld_b, n, t + k * n * 2);
+            ret = inst->SolveMV(m, t, n, t, n, row0_column1);
+            if (ret < 0) break;
+            for (size_t k = 0; k < m; ++k) Deinterleave(t + k * n * 2, n, xr + (k0 + k) * ld_x, xi + (k0 + k) * ld_x);
+        }
+        return ret;
+    }
+
+private:
+    static double *Interleave(const double re[], const double im[], size_t len, double out[])
+    {
+        for (size_t i = 0; i < len; ++i)
+        {
+            out[i + i] = re[i];
+            out[i + i + 1] = im[i];
+        }
+        return out;
+    }
+
+    static void Deinterleave(const double in[], size_t len, double re[], double im[])
+    {
+        for (size_t i = 0; i < len; ++i)
+        {
+            re[i] = in[i + i];
+            im[i] = in[i + i + 1];
+        }
+    }
+
+    HANDLE inst;
+    size_t n;
+    size_t nnz;
+    std::vector<double> ax; //interleaved matrix values
+    std::vector<double> v; //interleaved vector for Solve
+    std::vector<double> mv; //interleaved vectors for SolveMV
+    size_t group; //max_nrhs
+};
+
+#endif